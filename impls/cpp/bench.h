@@ -0,0 +1,48 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string_view>
+
+#include "core.h"
+
+// What the bench_*.cpp programs share.
+
+// How long function() takes, in milliseconds of wall-clock time.
+template<typename Function>
+double time_ms(Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The fastest of runs calls to function(), so that the first touch of the pages is not counted.
+template<typename Function>
+double best_ms(int runs, Function function)
+{
+    double best = 1e300;
+    for (int run = 0; run < runs; ++run)
+        best = std::min(best, time_ms(function));
+    return best;
+}
+
+// The builtin called name, for a bench that calls it directly rather than through EVAL.
+inline MalFunctionPtr core_function(CoreFunctionContainer& core_functions, std::string_view name)
+{
+    MalSymbol symbol { name };
+    return static_cast<MalFunction*>(core_functions.at(&symbol))->function_ptr();
+}
+
+// The resident memory of the process.
+inline long resident_kb()
+{
+    std::ifstream statm { "/proc/self/statm" };
+    long size = 0;
+    long resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
@@ -0,0 +1,62 @@
+// Increments one atom with (swap! counter + 1) from 1, 2, 4... threads up to one per hardware thread,
+// against the same increments under a mutex, as a global interpreter lock would do them. Prints the
+// throughput and the retries swap! needed, which are the contention on the atom.
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+template<typename Increment>
+static double run_threads(std::size_t threads, std::size_t increments, Increment increment)
+{
+    return time_ms([&] {
+        std::vector<std::thread> workers;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([&] {
+                for (std::size_t j = 0; j < increments; ++j)
+                    increment();
+            });
+        }
+        for (auto& worker : workers)
+            worker.join();
+    });
+}
+
+int main()
+{
+    auto core_functions = create_core_functions();
+    auto add = core_function(core_functions, "+");
+    auto swap = core_function(core_functions, "swap!");
+    auto atom_stats = core_function(core_functions, "atom-stats");
+    auto* plus = new MalFunction(add);
+    auto* one = new MalInteger(1);
+
+    std::size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> thread_counts;
+    for (std::size_t threads = 1; threads < hardware_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(hardware_threads);
+
+    constexpr std::size_t increments = 1000000;
+    for (auto threads : thread_counts) {
+        MalType* counter = new MalAtom(new MalInteger(0));
+        auto atom_ms = run_threads(threads, increments / threads, [&] {
+            MalType* arguments[] { counter, plus, one };
+            swap(3, arguments);
+        });
+
+        MalType* value = new MalInteger(0);
+        std::mutex mutex;
+        auto mutex_ms = run_threads(threads, increments / threads, [&] {
+            std::lock_guard lock { mutex };
+            MalType* arguments[] { value, one };
+            value = add(2, arguments);
+        });
+
+        auto rate = [](double ms) { return increments / ms / 1000; };
+        std::cout << threads << " threads  swap!: " << rate(atom_ms) << " M/s " << atom_stats(1, &counter)->inspect()
+                  << "  mutex: " << rate(mutex_ms) << " M/s\n";
+    }
+}
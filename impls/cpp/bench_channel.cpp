@@ -0,0 +1,92 @@
+// Sends messages through (chan 1024) with >!! and <!! from producer threads to consumer threads: one to
+// one and two to two with integers, which are passed as they are, and one isolate to another with small
+// maps, which are copied out of the sending isolate and adopted by the receiving one.
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "isolate.h"
+
+static MalFunctionPtr s_chan;
+static MalFunctionPtr s_put;
+static MalFunctionPtr s_take;
+static MalFunctionPtr s_close;
+
+// Each producer sends messages / producers values made by make_value; returns the messages taken.
+template<typename MakeValue, typename Run>
+static std::size_t run(std::size_t producers, std::size_t consumers, std::size_t messages, MakeValue make_value, Run run_in)
+{
+    MalType* capacity = new MalInteger(1024);
+    MalType* channel = s_chan(1, &capacity);
+    std::atomic<std::size_t> taken { 0 };
+    std::vector<std::thread> producer_threads;
+    std::vector<std::thread> consumer_threads;
+    for (std::size_t i = 0; i < consumers; ++i) {
+        consumer_threads.emplace_back([&] {
+            run_in([&] {
+                std::size_t count = 0;
+                while (s_take(1, &channel)->type() != MalType::Type::Nil)
+                    ++count;
+                taken += count;
+            });
+        });
+    }
+    for (std::size_t i = 0; i < producers; ++i) {
+        producer_threads.emplace_back([&, i] {
+            run_in([&] {
+                for (std::size_t j = 0; j < messages / producers; ++j) {
+                    MalType* arguments[] { channel, make_value(i, j) };
+                    s_put(2, arguments);
+                }
+            });
+        });
+    }
+    for (auto& thread : producer_threads)
+        thread.join();
+    s_close(1, &channel);
+    for (auto& thread : consumer_threads)
+        thread.join();
+    return taken;
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env { nullptr };
+    auto core_functions = create_core_functions();
+    for (auto [symbol, function] : core_functions)
+        core_env.set(symbol, function);
+    s_chan = core_function(core_functions, "chan");
+    s_put = core_function(core_functions, ">!!");
+    s_take = core_function(core_functions, "<!!");
+    s_close = core_function(core_functions, "close!");
+
+    std::vector<MalType*> integers;
+    for (long i = 0; i < 1024; ++i)
+        integers.push_back(new MalInteger(i));
+    auto integer = [&](std::size_t, std::size_t j) { return integers[j % integers.size()]; };
+    auto on_thread = [](auto body) { body(); };
+
+    constexpr std::size_t messages = 4000000;
+    for (auto [producers, consumers] : { std::pair { 1, 1 }, std::pair { 2, 2 } }) {
+        std::size_t taken = 0;
+        auto ms = time_ms([&] { taken = run(producers, consumers, messages, integer, on_thread); });
+        std::cout << producers << " -> " << consumers << " threads, integers: " << taken / ms / 1000 << " M messages/s\n";
+    }
+
+    auto* id = MalKeyword::intern(":id");
+    auto* amount = MalKeyword::intern(":amount");
+    auto record = [&](std::size_t, std::size_t j) {
+        MalType* entries[] { id, new MalInteger(j), amount, integers[j % integers.size()] };
+        return new MalHashMap(std::span(entries));
+    };
+    auto in_isolate = [&](auto body) {
+        Isolate isolate { core_env };
+        isolate.run([&](Env&) { body(); });
+    };
+    constexpr std::size_t records = 1000000;
+    std::size_t taken = 0;
+    auto ms = time_ms([&] { taken = run(1, 1, records, record, in_isolate); });
+    std::cout << "1 -> 1 isolates, {:id :amount} maps: " << taken / ms / 1000 << " M messages/s\n";
+}
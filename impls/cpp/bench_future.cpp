@@ -0,0 +1,64 @@
+// Fans fib out over futures, as (future (fib n)) does, on pools of 1, 2, 4... workers up to one per
+// hardware thread. fib adds boxed integers through the core functions, so that the tasks allocate as
+// evaluation does. The nested case splits every call above a cut-off into a future of its own, and so
+// relies on work stealing, and on deref running queued tasks while it waits.
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+static MalFunctionPtr s_add;
+static MalFunctionPtr s_deref;
+
+static MalType* fib(long n)
+{
+    if (n < 2)
+        return new MalInteger(n);
+    MalType* arguments[] { fib(n - 1), fib(n - 2) };
+    return s_add(2, arguments);
+}
+
+static MalType* nested_fib(WorkStealingPool& pool, long n, long cut_off)
+{
+    if (n <= cut_off)
+        return fib(n);
+    MalType* left = future_call([&pool, n, cut_off] { return nested_fib(pool, n - 1, cut_off); }, pool);
+    MalType* arguments[] { nested_fib(pool, n - 2, cut_off), s_deref(1, &left) };
+    return s_add(2, arguments);
+}
+
+int main()
+{
+    auto core_functions = create_core_functions();
+    s_add = core_function(core_functions, "+");
+    s_deref = core_function(core_functions, "deref");
+
+    constexpr std::size_t tasks = 64;
+    constexpr long n = 22;
+    auto serial_ms = time_ms([] {
+        for (std::size_t i = 0; i < tasks; ++i)
+            fib(n);
+    });
+    std::cout << tasks << " x fib(" << n << "), serial: " << serial_ms << " ms\n";
+
+    std::size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> worker_counts;
+    for (std::size_t workers = 1; workers < hardware_threads; workers *= 2)
+        worker_counts.push_back(workers);
+    worker_counts.push_back(hardware_threads);
+    for (auto workers : worker_counts) {
+        WorkStealingPool pool { workers };
+        auto fan_out_ms = time_ms([&] {
+            std::vector<MalType*> futures;
+            for (std::size_t i = 0; i < tasks; ++i)
+                futures.push_back(future_call([] { return fib(n); }, pool));
+            for (auto* future : futures)
+                s_deref(1, &future);
+        });
+        MalType* result = nullptr;
+        auto nested_ms = time_ms([&] { result = nested_fib(pool, 32, 20); });
+        std::cout << workers << " workers  fan-out: " << fan_out_ms << " ms (" << serial_ms / fan_out_ms << "x)  nested fib(32): "
+                  << nested_ms << " ms = " << result->inspect() << '\n';
+    }
+}
@@ -0,0 +1,66 @@
+// Reads a synthetic dataset of records that repeat the same field names, strings and small vectors,
+// once per ReadMode, each in a fresh child process, and reports how much the resident set grew.
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "reader.h"
+#include "types.h"
+
+constexpr std::size_t g_records = 200'000;
+
+static std::string make_dataset()
+{
+    char const* names[] { "\"alice\"", "\"bob\"", "\"carol\"", "\"dave\"", "\"erin\"" };
+    char const* departments[] { "\"engineering\"", "\"sales\"", "\"support\"" };
+    char const* tags[] { "[:remote :full-time]", "[:office :full-time]", "[:remote :contractor]" };
+    std::mt19937 random { 42 };
+    std::string dataset = "[";
+    for (std::size_t i = 0; i < g_records; ++i) {
+        dataset += "{:name ";
+        dataset += names[random() % 5];
+        dataset += " :department ";
+        dataset += departments[random() % 3];
+        dataset += " :tags ";
+        dataset += tags[random() % 3];
+        dataset += " :level " + std::to_string(random() % 4) + "} ";
+    }
+    dataset += ']';
+    return dataset;
+}
+
+static void read_in_child(std::string const& dataset, ReadMode mode, char const* name)
+{
+    if (fork() != 0) {
+        wait(nullptr);
+        return;
+    }
+    auto input = dataset;
+    auto before_kb = resident_kb();
+    MalType* ast = nullptr;
+    auto read_ms = time_ms([&] { ast = read_str(input, mode); });
+    auto grown_kb = resident_kb() - before_kb;
+
+    // With shared subtrees, comparing records stops at the first shared pointer.
+    auto* records = static_cast<MalVector*>(ast);
+    std::size_t equal = 0;
+    auto compare_ms = time_ms([&] {
+        for (std::size_t i = 1; i < records->size(); ++i)
+            equal += *records->at(i) == *records->at(i - 1);
+    });
+
+    std::cout << name << "  RSS growth: " << grown_kb / 1024.0 << " MB  read: " << read_ms << " ms"
+              << "  compare neighbours: " << compare_ms << " ms  (" << equal << " equal)\n";
+    std::exit(0);
+}
+
+int main()
+{
+    auto const dataset = make_dataset();
+    std::cout << g_records << " records, " << dataset.size() / (1024.0 * 1024.0) << " MB of text\n" << std::flush;
+    read_in_child(dataset, ReadMode::Heap, "heap       ");
+    read_in_child(dataset, ReadMode::HashConsed, "hash-consed");
+}
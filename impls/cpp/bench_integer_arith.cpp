@@ -0,0 +1,53 @@
+// Times the core + on small integers, which must stay as fast as unchecked long arithmetic, and the
+// BigInteger multiply at growing sizes, where Karatsuba should scale as n^1.58 rather than n^2.
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+
+int main()
+{
+    auto core_functions = create_core_functions();
+    auto add = core_function(core_functions, "+");
+    auto multiply = core_function(core_functions, "*");
+
+    constexpr long additions = 10'000'000;
+    auto* one = new MalInteger(1);
+    long checked_sum = 0;
+    auto checked_ms = time_ms([&] {
+        MalType* sum = new MalInteger(0);
+        for (long i = 0; i < additions; ++i) {
+            MalType* arguments[] { sum, one };
+            sum = add(2, arguments);
+        }
+        checked_sum = static_cast<MalInteger*>(sum)->value();
+    });
+    long unchecked_sum = 0;
+    auto unchecked_ms = time_ms([&] {
+        MalType* sum = new MalInteger(0);
+        for (long i = 0; i < additions; ++i)
+            sum = new MalInteger(static_cast<MalInteger*>(sum)->value() + one->value());
+        unchecked_sum = static_cast<MalInteger*>(sum)->value();
+    });
+    std::cout << additions << " small additions  core +: " << checked_ms << " ms  unchecked: " << unchecked_ms << " ms"
+              << (checked_sum == unchecked_sum ? "" : "  MISMATCH") << '\n';
+
+    MalType* factorial = new MalInteger(1);
+    auto factorial_ms = time_ms([&] {
+        for (long i = 2; i <= 3000; ++i) {
+            MalType* arguments[] { factorial, new MalInteger(i) };
+            factorial = multiply(2, arguments);
+        }
+    });
+    std::cout << "3000! (" << factorial->inspect().length() << " digits): " << factorial_ms << " ms\n";
+
+    for (std::size_t digits : { 1'000, 10'000, 100'000 }) {
+        auto* lhs = new MalBigInteger(BigInteger::from_string(std::string(digits, '7')));
+        auto* rhs = new MalBigInteger(BigInteger::from_string(std::string(digits, '3')));
+        MalType* arguments[] { lhs, rhs };
+        MalType* product = nullptr;
+        auto product_ms = time_ms([&] { product = multiply(2, arguments); });
+        std::cout << digits << " x " << digits << " digits: " << product_ms << " ms ("
+                  << product->inspect().length() << " digits)\n";
+    }
+}
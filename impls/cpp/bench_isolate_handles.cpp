@@ -0,0 +1,81 @@
+// A service that runs each request in an isolate of its own and keeps the results of the last 64
+// requests through Isolate::Handles, destroying each isolate as soon as its request is done. Prints the
+// cost of copying a handle, and the resident memory against the bytes of the regions the kept results
+// hold, as requests come and go: the memory of a result goes back when its last handle does, into the
+// ChunkRecycler's pool by default, and to the system when the pool is turned off. A region also holds
+// the temporaries its request made, so this is more than the results themselves take.
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+#include "isolate.h"
+
+// A result of records maps, and the temporaries that making it left behind.
+static MalType* handle_request(std::size_t request, std::size_t records, MalKeyword* id, MalKeyword* amount)
+{
+    std::vector<MalType*> elements;
+    for (std::size_t i = 0; i < records; ++i) {
+        new MalString("a line of input the request parsed");
+        MalType* entries[] { id, new MalInteger(static_cast<long>(request)), amount, new MalInteger(static_cast<long>(i)) };
+        elements.push_back(new MalHashMap(std::span(entries)));
+    }
+    return new MalVector(elements);
+}
+
+static void run_requests(Env& core_env, MalKeyword* id, MalKeyword* amount)
+{
+    constexpr std::size_t kept_results = 64;
+    constexpr std::size_t requests = 20000;
+    std::vector<Isolate::Handle> results(kept_results);
+    std::vector<std::size_t> result_bytes(kept_results);
+    auto baseline_kb = resident_kb();
+    for (std::size_t request = 0; request < requests; ++request) {
+        // Requests vary in size, so that the memory held grows and shrinks.
+        auto records = request / 2000 % 2 ? 200 : 4000;
+        Isolate isolate { core_env };
+        auto slot = request % kept_results;
+        results[slot] = isolate.keep(isolate.run([&](Env&) { return handle_request(request, records, id, amount); }));
+        result_bytes[slot] = isolate.region().allocated_bytes();
+        if (request % 4000 == 1999 || request % 4000 == 3999) {
+            std::size_t held_bytes = 0;
+            for (auto bytes : result_bytes)
+                held_bytes += bytes;
+            std::cout << "  " << request + 1 << " requests: kept regions " << held_bytes / 1024 << " KB, resident "
+                      << resident_kb() - baseline_kb << " KB above the start\n";
+        }
+    }
+    for (auto const& result : results) {
+        auto* first = static_cast<MalHashMap*>(static_cast<MalVector*>(result.get())->at(0));
+        if (static_cast<MalInteger*>(first->find(id))->value() + kept_results < requests)
+            std::cerr << "a kept result is not one of the last " << kept_results << "\n";
+    }
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env { nullptr };
+    for (auto [symbol, function] : create_core_functions())
+        core_env.set(symbol, function);
+    auto* id = MalKeyword::intern(":id");
+    auto* amount = MalKeyword::intern(":amount");
+
+    {
+        Isolate isolate { core_env };
+        auto handle = isolate.keep(isolate.run([](Env&) { return new MalInteger(1); }));
+        constexpr std::size_t copies = 10000000;
+        std::vector<Isolate::Handle> handles(2, handle);
+        auto elapsed_ms = time_ms([&] {
+            for (std::size_t i = 0; i < copies; ++i)
+                handles[i % 2] = handles[(i + 1) % 2];
+        });
+        std::cout << "handle copy and release: " << elapsed_ms * 1e6 / copies << " ns\n";
+    }
+
+    for (auto max_pooled_chunks : { ChunkRecycler::default_max_pooled_chunks, std::size_t(0) }) {
+        ChunkRecycler::instance().set_max_pooled_chunks(max_pooled_chunks);
+        std::cout << "keeping up to " << max_pooled_chunks << " chunks for reuse:\n";
+        run_requests(core_env, id, amount);
+    }
+    return 0;
+}
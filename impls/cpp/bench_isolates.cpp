@@ -0,0 +1,103 @@
+// Runs many small tenant scripts, each in an isolate of its own, on 1, 2, 4... threads up to one per
+// hardware thread. A script reads a vector of maps, binds it in the isolate's env and sums a field with
+// the core functions, whose Env all isolates share. Prints the cost of an empty isolate, the scripts
+// run per second, and the peak memory of running them with and without isolates, whose regions give
+// each script's memory back when it ends.
+#include <sys/resource.h>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "isolate.h"
+#include "reader.h"
+
+static long peak_memory_kb()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static std::string make_script(std::size_t records)
+{
+    std::string script = "[";
+    for (std::size_t i = 0; i < records; ++i)
+        script += "{:id " + std::to_string(i) + " :name \"tenant record\" :amount " + std::to_string(i % 100) + "} ";
+    return script + "]";
+}
+
+// Made before any isolate, as values shared by isolates must be.
+static MalSymbol* s_records;
+static MalSymbol* s_add;
+static MalSymbol* s_get;
+static MalKeyword* s_amount;
+
+static MalType* run_script(Env& env, std::string script)
+{
+    env.set(s_records, read_str(script));
+    auto add = static_cast<MalFunction*>(env.get(s_add))->function();
+    auto get = static_cast<MalFunction*>(env.get(s_get))->function();
+    MalType* sum = new MalInteger(0);
+    for (auto* record : *static_cast<MalVector*>(env.get(s_records))) {
+        MalType* get_arguments[] { record, s_amount };
+        MalType* add_arguments[] { sum, get(2, get_arguments) };
+        sum = add(2, add_arguments);
+    }
+    return sum;
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env { nullptr };
+    for (auto [symbol, function] : create_core_functions())
+        core_env.set(symbol, function);
+    s_records = new MalSymbol("records");
+    s_add = new MalSymbol("+");
+    s_get = new MalSymbol("get");
+    s_amount = MalKeyword::intern(":amount");
+
+    constexpr std::size_t empty_isolates = 100000;
+    auto empty_ms = time_ms([&] {
+        for (std::size_t i = 0; i < empty_isolates; ++i) {
+            Isolate isolate { core_env };
+            isolate.run([](Env& env) { env.set(new MalSymbol("x"), new MalInteger(1)); });
+        }
+    });
+    std::cout << "empty isolate with one def: " << empty_ms * 1e6 / empty_isolates << " ns\n";
+
+    auto script = make_script(200);
+    constexpr std::size_t scripts = 20000;
+    std::size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> thread_counts;
+    for (std::size_t threads = 1; threads < hardware_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(hardware_threads);
+
+    for (auto threads : thread_counts) {
+        auto ms = time_ms([&] {
+            std::vector<std::thread> workers;
+            for (std::size_t i = 0; i < threads; ++i) {
+                workers.emplace_back([&] {
+                    for (std::size_t j = 0; j < scripts / threads; ++j) {
+                        Isolate isolate { core_env };
+                        isolate.run([&](Env& env) { return run_script(env, script); });
+                    }
+                });
+            }
+            for (auto& worker : workers)
+                worker.join();
+        });
+        std::cout << threads << " threads: " << scripts / ms * 1000 << " scripts/s, peak memory " << peak_memory_kb() / 1024 << " MB\n";
+    }
+
+    // The same scripts in one shared env, as before isolates: nothing they make is ever freed.
+    Env shared_env { &core_env };
+    auto shared_ms = time_ms([&] {
+        for (std::size_t j = 0; j < scripts; ++j)
+            run_script(shared_env, script);
+    });
+    std::cout << "without isolates: " << scripts / shared_ms * 1000 << " scripts/s, peak memory " << peak_memory_kb() / 1024 << " MB\n";
+}
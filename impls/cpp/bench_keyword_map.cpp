@@ -0,0 +1,76 @@
+// Looks up keyword keys in hash maps of a few sizes, with interned keywords and with keywords that are
+// compared and hashed by their names on every use, as MalKeyword used to be. Small maps of interned
+// keywords are also timed as MalHashMap records, which find a key's slot in their shape.
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bench.h"
+#include "types.h"
+
+constexpr std::size_t g_lookups = 2'000'000;
+
+class NamedKeyword : public MalType {
+public:
+    NamedKeyword(std::string_view str)
+        : m_str(str)
+    {
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (type() != other.type())
+            return false;
+        return m_str == static_cast<NamedKeyword const&>(other).m_str;
+    }
+
+    std::size_t hash() const override { return std::hash<std::string> {}(m_str); }
+    std::string inspect([[maybe_unused]] bool print_readably = false) const override { return m_str; }
+    Type type() const override { return Type::Keyword; }
+
+private:
+    std::string m_str;
+};
+
+// The map's keys and the lookup keys are made separately, as when a program reads a keyword again.
+template<typename HashMap, typename MakeKeyword>
+static double time_lookups(std::size_t keys, MakeKeyword make_keyword, long& checksum)
+{
+    HashMap hash_map;
+    std::vector<MalType*> lookup_keys;
+    for (std::size_t i = 0; i < keys; ++i) {
+        auto name = ":field-" + std::to_string(i);
+        if constexpr (std::is_same_v<HashMap, MalHashMap>)
+            hash_map.insert_or_assign(make_keyword(name), new MalInteger(static_cast<long>(i)));
+        else
+            hash_map = hash_map.assoc(make_keyword(name), new MalInteger(static_cast<long>(i)));
+        lookup_keys.push_back(make_keyword(name));
+    }
+    return time_ms([&] {
+        for (std::size_t i = 0; i < g_lookups; ++i)
+            checksum += static_cast<MalInteger*>(hash_map.find(lookup_keys[i % keys]))->value();
+    });
+}
+
+int main()
+{
+    for (std::size_t keys : { 4, 8, 16, 1000 }) {
+        auto make_named = [](std::string const& name) { return new NamedKeyword(name); };
+        auto make_interned = [](std::string const& name) { return MalKeyword::intern(name); };
+        long named_checksum = 0;
+        long interned_checksum = 0;
+        auto named_ms = time_lookups<MalHashMap::Map>(keys, make_named, named_checksum);
+        auto interned_ms = time_lookups<MalHashMap::Map>(keys, make_interned, interned_checksum);
+        std::cout << keys << " keys  compared by name: " << named_ms * 1e6 / g_lookups << " ns/lookup"
+                  << "  interned: " << interned_ms * 1e6 / g_lookups << " ns/lookup";
+        if (keys <= RecordShape::max_keys) {
+            long record_checksum = 0;
+            auto record_ms = time_lookups<MalHashMap>(keys, make_interned, record_checksum);
+            std::cout << "  record: " << record_ms * 1e6 / g_lookups << " ns/lookup";
+            if (record_checksum != interned_checksum)
+                std::cout << "  MISMATCH";
+        }
+        std::cout << (named_checksum == interned_checksum ? "" : "  MISMATCH") << '\n';
+    }
+}
@@ -0,0 +1,53 @@
+// Walks lists with first/rest and builds them with cons, to check that both stay linear in the list length.
+// For comparison, also walks with a rest that copies the remaining elements, as MalList used to have to.
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+#include "types.h"
+
+static MalList* build_by_cons(std::size_t length)
+{
+    auto* list = new MalList();
+    for (std::size_t i = 0; i < length; ++i)
+        list = list->cons(new MalInteger(static_cast<long int>(i)));
+    return list;
+}
+
+static long walk_by_rest(MalList* list)
+{
+    long sum = 0;
+    for (; !list->empty(); list = list->rest())
+        sum += static_cast<MalInteger*>(list->at(0))->value();
+    return sum;
+}
+
+static long walk_by_copying_rest(MalList* list)
+{
+    long sum = 0;
+    std::vector<MalType*> remaining(list->begin(), list->end());
+    while (!remaining.empty()) {
+        sum += static_cast<MalInteger*>(remaining[0])->value();
+        remaining = std::vector<MalType*>(remaining.begin() + 1, remaining.end());
+    }
+    return sum;
+}
+
+int main()
+{
+    for (std::size_t length : { 10'000, 100'000, 1'000'000 }) {
+        MalList* list = nullptr;
+        auto cons_ms = time_ms([&] { list = build_by_cons(length); });
+        long sum = 0;
+        auto rest_ms = time_ms([&] { sum = walk_by_rest(list); });
+        std::cout << length << " elements  cons: " << cons_ms << " ms  rest walk: " << rest_ms << " ms";
+        if (length <= 100'000) {
+            long copying_sum = 0;
+            auto copying_ms = time_ms([&] { copying_sum = walk_by_copying_rest(list); });
+            std::cout << "  copying rest walk: " << copying_ms << " ms";
+            if (copying_sum != sum)
+                std::cout << "  MISMATCH";
+        }
+        std::cout << "  (checksum " << sum << ")\n";
+    }
+}
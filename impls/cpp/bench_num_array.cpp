@@ -0,0 +1,57 @@
+// Sums, dot products and filters over 10M numbers: boxed in a MalVector and added with the core +, as
+// a mal loop would, against the num-array kernels, both the scalar and the AVX2 versions.
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+#include "numeric_kernels.h"
+
+static void report(char const* name, double ms, std::size_t elements, std::size_t bytes_per_element)
+{
+    std::cout << name << ": " << ms << " ms, " << ms * 1e6 / elements << " ns/element, "
+              << elements * bytes_per_element / (ms * 1e6) << " GB/s\n";
+}
+
+int main()
+{
+    constexpr std::size_t size = 10'000'000;
+    auto core_functions = create_core_functions();
+    auto add = core_function(core_functions, "+");
+
+    std::vector<long> integers(size);
+    std::vector<double> floats(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        integers[i] = static_cast<long>(i % 1000) - 500;
+        floats[i] = static_cast<double>(i % 1000) / 8;
+    }
+    auto transient = PersistentVector().transient();
+    for (auto value : integers)
+        transient.conj_in_place(new MalInteger(value));
+    MalVector boxed { transient.persistent() };
+    std::span<long const> integer_span { integers };
+    std::span<double const> float_span { floats };
+    std::cout << "AVX2 available: " << (NumericKernels::has_avx2() ? "yes" : "no") << '\n';
+
+    long checksum = 0;
+    report("boxed vector, core +", best_ms(3, [&] {
+        MalType* sum = new MalInteger(0);
+        for (auto* element : boxed) {
+            MalType* arguments[] { sum, element };
+            sum = add(2, arguments);
+        }
+        checksum += static_cast<MalInteger*>(sum)->value();
+    }), size, sizeof(MalType*));
+    report("long sum, scalar", best_ms(3, [&] { checksum += *NumericKernels::scalar_sum(integer_span); }), size, sizeof(long));
+    report("long sum, AVX2", best_ms(3, [&] { checksum += *NumericKernels::avx2_sum(integer_span); }), size, sizeof(long));
+
+    double float_checksum = 0;
+    report("double sum, scalar", best_ms(3, [&] { float_checksum += NumericKernels::scalar_sum(float_span); }), size, sizeof(double));
+    report("double sum, AVX2", best_ms(3, [&] { float_checksum += NumericKernels::avx2_sum(float_span); }), size, sizeof(double));
+    report("double dot, scalar", best_ms(3, [&] { float_checksum += NumericKernels::scalar_dot(float_span, float_span); }), size, 2 * sizeof(double));
+    report("double dot, AVX2", best_ms(3, [&] { float_checksum += NumericKernels::avx2_dot(float_span, float_span); }), size, 2 * sizeof(double));
+
+    std::vector<double> filtered(size);
+    report("double filter<, scalar", best_ms(3, [&] { checksum += NumericKernels::scalar_filter_less(float_span, 60.0, filtered.data()); }), size, 2 * sizeof(double));
+    report("double filter<, AVX2", best_ms(3, [&] { checksum += NumericKernels::avx2_filter_less(float_span, 60.0, filtered.data()); }), size, 2 * sizeof(double));
+    std::cout << "(checksums " << checksum << ' ' << float_checksum << ")\n";
+}
@@ -0,0 +1,74 @@
+// Runs pmap, pfilter and fold over a vector on pools of 1, 2, 4... workers up to one per hardware thread,
+// and compares their throughput with a plain loop over the same function. The cheap case adds 1 to each
+// of a million integers, so that chunking and merging cost as much as the work; the costly case computes
+// fib(12) of each of ten thousand elements, and should scale with the workers.
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+static MalFunctionPtr s_add;
+
+static MalType* fib(long n)
+{
+    if (n < 2)
+        return new MalInteger(n);
+    MalType* arguments[] { fib(n - 1), fib(n - 2) };
+    return s_add(2, arguments);
+}
+
+static void run(std::string_view name, std::size_t size, MalFunctionPtr const& function, std::vector<std::size_t> const& worker_counts)
+{
+    std::vector<MalType*> elements;
+    for (std::size_t i = 0; i < size; ++i)
+        elements.push_back(new MalInteger(i));
+    auto* vector = new MalVector(elements);
+    auto is_odd = [](size_t, MalType** argv) -> MalType* {
+        if (static_cast<MalInteger*>(argv[0])->value() % 2)
+            return new MalTrue();
+        return new MalFalse();
+    };
+    auto reduce = [&function](size_t, MalType** argv) {
+        MalType* arguments[] { argv[0], function(1, &argv[1]) };
+        return s_add(2, arguments);
+    };
+
+    auto serial_ms = time_ms([&] {
+        for (std::size_t i = 0; i < size; ++i) {
+            MalType* argument = vector->at(i);
+            function(1, &argument);
+        }
+    });
+    auto rate = [size](double ms) { return size / ms / 1000; };
+    std::cout << name << ", " << size << " elements, serial loop: " << rate(serial_ms) << " M/s\n";
+
+    for (auto workers : worker_counts) {
+        WorkStealingPool pool { workers };
+        auto map_ms = time_ms([&] { parallel_map(function, vector, pool); });
+        auto filter_ms = time_ms([&] { parallel_filter(is_odd, parallel_map(function, vector, pool), pool); });
+        MalType* sum = nullptr;
+        auto fold_ms = time_ms([&] { sum = parallel_fold(s_add, reduce, vector, 0, pool); });
+        std::cout << "  " << workers << " workers  pmap: " << rate(map_ms) << " M/s (" << serial_ms / map_ms
+                  << "x)  pmap+pfilter: " << rate(filter_ms) << " M/s  fold: " << rate(fold_ms) << " M/s = "
+                  << sum->inspect() << '\n';
+    }
+}
+
+int main()
+{
+    auto core_functions = create_core_functions();
+    s_add = core_function(core_functions, "+");
+
+    std::size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> worker_counts;
+    for (std::size_t workers = 1; workers < hardware_threads; workers *= 2)
+        worker_counts.push_back(workers);
+    worker_counts.push_back(hardware_threads);
+
+    run("(+ x 1)", 1000000, [](size_t, MalType** argv) {
+        MalType* arguments[] { argv[0], new MalInteger(1) };
+        return s_add(2, arguments);
+    }, worker_counts);
+    run("(fib 12)", 10000, [](size_t, MalType**) { return fib(12); }, worker_counts);
+}
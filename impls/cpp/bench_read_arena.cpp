@@ -0,0 +1,80 @@
+// Reads a large vector-of-vectors literal in both ReadModes and then walks it, to compare the cost
+// of the read itself and of traversing the resulting nodes.
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "reader.h"
+#include "types.h"
+
+constexpr std::size_t g_rows = 1000;
+constexpr std::size_t g_columns = 1000;
+constexpr int g_walks = 10;
+
+static std::string make_literal()
+{
+    std::string literal = "[";
+    for (std::size_t row = 0; row < g_rows; ++row) {
+        literal += '[';
+        for (std::size_t column = 0; column < g_columns; ++column)
+            literal += std::to_string(row * g_columns + column) + ' ';
+        literal += "] ";
+    }
+    literal += ']';
+    return literal;
+}
+
+// A long-running interpreter's heap is not fresh: leave holes of random sizes all over it,
+// so heap mode nodes do not land next to each other by accident.
+static void fragment_heap()
+{
+    std::mt19937 random { 42 };
+    std::uniform_int_distribution<std::size_t> size { 16, 96 };
+    std::vector<void*> blocks(4 * g_rows * g_columns);
+    for (auto& block : blocks)
+        block = std::malloc(size(random));
+    for (std::size_t i = 0; i < blocks.size(); i += 2)
+        std::free(blocks[i]);
+}
+
+static long walk(MalType* ast)
+{
+    switch (ast->type()) {
+    case MalType::Type::Vector: {
+        long sum = 0;
+        for (auto* element : *static_cast<MalVector*>(ast))
+            sum += walk(element);
+        return sum;
+    }
+    case MalType::Type::Integer:
+        return static_cast<MalInteger*>(ast)->value();
+    default:
+        return 0;
+    }
+}
+
+int main()
+{
+    fragment_heap();
+    auto const literal = make_literal();
+
+    for (auto mode : { ReadMode::Heap, ReadMode::Arena }) {
+        auto input = literal;
+        MalType* ast = nullptr;
+        auto read_ms = time_ms([&] { ast = read_str(input, mode); });
+
+        long sum = 0;
+        auto walk_ms = time_ms([&] {
+            for (int i = 0; i < g_walks; ++i)
+                sum += walk(ast);
+        });
+
+        std::cout << (mode == ReadMode::Heap ? "heap " : "arena")
+                  << "  read: " << read_ms << " ms"
+                  << "  walk: " << walk_ms / g_walks << " ms"
+                  << "  (checksum " << sum << ")\n";
+    }
+}
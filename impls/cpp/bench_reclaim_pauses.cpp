@@ -0,0 +1,68 @@
+// Measures how long a thread stops to destroy an isolate, against freeing the isolate's chunks on the
+// spot as regions used to. An isolate fills its region with integers up to 64 MB, 256 MB and 1 GB, and
+// the destructor's pause is timed; then many small isolates are made and destroyed, as a server running
+// tenant scripts would, and the longest pause of the ChunkRecycler is printed with the run time. These
+// are the pauses of handing regions over; there is no collector whose pauses to measure.
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+#include "isolate.h"
+
+static void fill(Isolate& isolate, std::size_t bytes)
+{
+    isolate.run([&](Env&) {
+        while (isolate.region().allocated_bytes() < bytes) {
+            for (long i = 0; i < 1000; ++i)
+                new MalInteger(i);
+        }
+    });
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env { nullptr };
+    for (auto [symbol, function] : create_core_functions())
+        core_env.set(symbol, function);
+
+    constexpr std::size_t megabyte = 1024 * 1024;
+    for (std::size_t size : { 64 * megabyte, 256 * megabyte, 1024 * megabyte }) {
+        auto* isolate = new Isolate(core_env);
+        fill(*isolate, size);
+        auto recycled_ms = time_ms([&] { delete isolate; });
+
+        // The same chunks, touched the same way, freed one by one.
+        std::vector<void*> chunks;
+        for (std::size_t i = 0; i < size / ThreadLocalHeap::chunk_size; ++i) {
+            chunks.push_back(::operator new(ThreadLocalHeap::chunk_size));
+            for (std::size_t offset = 0; offset < ThreadLocalHeap::chunk_size; offset += 4096)
+                static_cast<char*>(chunks.back())[offset] = 1;
+        }
+        auto freed_ms = time_ms([&] {
+            for (auto* chunk : chunks)
+                ::operator delete(chunk);
+        });
+        std::cout << size / megabyte << " MB isolate: destroyed in " << recycled_ms * 1000 << " us, freed on the spot in "
+                  << freed_ms * 1000 << " us\n";
+    }
+
+    constexpr std::size_t small_isolates = 20000;
+    constexpr std::size_t small_size = 1 * megabyte;
+    auto before = ChunkRecycler::instance().pauses().counts();
+    auto small_ms = time_ms([&] {
+        for (std::size_t i = 0; i < small_isolates; ++i) {
+            Isolate isolate { core_env };
+            fill(isolate, small_size);
+        }
+    });
+    auto counts = ChunkRecycler::instance().pauses().counts();
+    for (std::size_t i = 0; i < counts.size(); ++i)
+        counts[i] -= before[i];
+    std::uint64_t pauses = 0;
+    for (auto count : counts)
+        pauses += count;
+    std::cout << small_isolates << " isolates of 1 MB: " << small_ms << " ms, " << pauses << " pauses to hand regions over, the longest < "
+              << PauseHistogram::longest(counts) << " us\n";
+    return 0;
+}
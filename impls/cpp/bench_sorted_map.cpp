@@ -0,0 +1,74 @@
+// Builds a sorted map of 1M integer keys and times range scans of a few sizes against it,
+// next to the old way of collecting every entry of a hash map and sorting them first.
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "bench.h"
+#include "types.h"
+
+constexpr long g_keys = 1'000'000;
+constexpr int g_queries = 1000;
+
+static long key_value(MalType* key)
+{
+    return static_cast<MalInteger*>(key)->value();
+}
+
+// Sums the keys in [from, from + length), as (subseq m >= from < (+ from length)) would visit them.
+static long scan(MalSortedMap::Map const& map, long from, long length)
+{
+    MalInteger end { from + length };
+    MalInteger start { from };
+    long sum = 0;
+    for (auto it = map.ascending_from(&start, true); it != map.end() && MalSortedKeyTraits::compare((*it).first, &end) < 0; ++it)
+        sum += key_value((*it).first);
+    return sum;
+}
+
+static long scan_by_sorting(MalHashMap const& hash_map, long from, long length)
+{
+    std::vector<MalType*> keys;
+    keys.reserve(hash_map.size());
+    for (auto [key, value] : hash_map)
+        keys.push_back(key);
+    std::sort(keys.begin(), keys.end(), [](MalType* lhs, MalType* rhs) { return key_value(lhs) < key_value(rhs); });
+    long sum = 0;
+    for (auto* key : keys) {
+        if (key_value(key) >= from && key_value(key) < from + length)
+            sum += key_value(key);
+    }
+    return sum;
+}
+
+int main()
+{
+    MalSortedMap::Map sorted_map;
+    MalHashMap hash_map;
+    auto build_ms = time_ms([&] {
+        // Inserted in a scrambled order, so the tree has to rebalance.
+        for (long i = 0; i < g_keys; ++i) {
+            auto* key = new MalInteger((i * 7919) % g_keys);
+            sorted_map = sorted_map.assoc(key, key);
+        }
+    });
+    for (auto [key, value] : sorted_map)
+        hash_map.insert_or_assign(key, value);
+    std::cout << g_keys << " keys  build: " << build_ms << " ms\n";
+
+    for (long length : { 10, 1000, 100'000 }) {
+        long sum = 0;
+        auto scan_ms = time_ms([&] {
+            for (int i = 0; i < g_queries; ++i)
+                sum += scan(sorted_map, (i * 104729L) % (g_keys - length), length);
+        });
+        std::cout << "range of " << length << "  subseq: " << scan_ms * 1000 / g_queries << " us";
+
+        long sorting_sum = 0;
+        auto sorting_ms = time_ms([&] { sorting_sum = scan_by_sorting(hash_map, 0, length); });
+        std::cout << "  sort all then scan: " << sorting_ms * 1000 << " us";
+        if (scan(sorted_map, 0, length) != sorting_sum)
+            std::cout << "  MISMATCH";
+        std::cout << "  (checksum " << sum << ")\n";
+    }
+}
@@ -0,0 +1,50 @@
+// Builds long strings by appending short pieces one at a time, the way (str acc x) in a loop and
+// sb-append! do, through the core functions themselves. For comparison it also appends by copying the
+// whole string each time, as str used to.
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+
+int main()
+{
+    auto core_functions = create_core_functions();
+    auto str = core_function(core_functions, "str");
+    auto sb_new = core_function(core_functions, "sb-new");
+    auto sb_append = core_function(core_functions, "sb-append!");
+    auto sb_to_str = core_function(core_functions, "sb->str");
+    auto* piece = new MalString("0123456789");
+
+    for (std::size_t appends : { 10'000, 100'000, 1'000'000 }) {
+        std::size_t length = 0;
+        auto str_ms = time_ms([&] {
+            MalType* accumulated = new MalString("");
+            for (std::size_t i = 0; i < appends; ++i) {
+                MalType* arguments[] { accumulated, piece };
+                accumulated = str(2, arguments);
+            }
+            // Printing or comparing the result flattens it.
+            length = static_cast<MalString*>(accumulated)->value().length();
+        });
+
+        auto builder_ms = time_ms([&] {
+            auto* builder = sb_new(0, nullptr);
+            for (std::size_t i = 0; i < appends; ++i) {
+                MalType* arguments[] { builder, piece };
+                sb_append(2, arguments);
+            }
+            length += static_cast<MalString*>(sb_to_str(1, &builder))->length();
+        });
+
+        std::cout << appends << " appends (" << length / 2 / (1024.0 * 1024.0) << " MB)  str: " << str_ms << " ms  sb-append!: " << builder_ms << " ms";
+        if (appends <= 100'000) {
+            auto copying_ms = time_ms([&] {
+                std::string accumulated;
+                for (std::size_t i = 0; i < appends; ++i)
+                    accumulated = accumulated + std::string(piece->value());
+            });
+            std::cout << "  copying str: " << copying_ms << " ms";
+        }
+        std::cout << '\n';
+    }
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An arbitrary-precision integer: a sign and a magnitude of 32-bit limbs, least significant first,
+// without leading zero limbs (zero has no limbs and is never negative).
+// Multiplication is schoolbook for small operands and Karatsuba above karatsuba_threshold limbs;
+// division is Knuth's algorithm D. Division truncates towards zero, like C++.
+class BigInteger {
+public:
+    using Limb = std::uint32_t;
+    using DoubleLimb = std::uint64_t;
+    using Magnitude = std::vector<Limb>;
+
+    static constexpr std::size_t limb_bits = 32;
+    static constexpr std::size_t karatsuba_threshold = 32;
+
+    BigInteger() = default;
+
+    explicit BigInteger(long value)
+        : m_negative(value < 0)
+    {
+        // Negating as unsigned also works for LONG_MIN.
+        auto magnitude = value < 0 ? 0UL - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+        for (; magnitude; magnitude >>= limb_bits)
+            m_limbs.push_back(static_cast<Limb>(magnitude));
+    }
+
+    // Decimal digits, with an optional leading '-'.
+    static BigInteger from_string(std::string_view decimal)
+    {
+        BigInteger result;
+        bool negative = !decimal.empty() && decimal[0] == '-';
+        if (negative)
+            decimal.remove_prefix(1);
+        // Nine digits at a time, so that each step is one multiply-add by a single limb.
+        while (!decimal.empty()) {
+            auto chunk_length = std::min<std::size_t>(9, decimal.length());
+            Limb chunk = 0;
+            Limb scale = 1;
+            for (auto digit : decimal.substr(0, chunk_length)) {
+                assert(digit >= '0' && digit <= '9');
+                chunk = chunk * 10 + (digit - '0');
+                scale *= 10;
+            }
+            multiply_add(result.m_limbs, scale, chunk);
+            decimal.remove_prefix(chunk_length);
+        }
+        result.m_negative = negative && !result.m_limbs.empty();
+        return result;
+    }
+
+    std::string to_string() const
+    {
+        if (m_limbs.empty())
+            return "0";
+        // Peel off nine digits at a time, least significant first.
+        std::string result;
+        auto magnitude = m_limbs;
+        while (!magnitude.empty()) {
+            auto chunk = divide_by_limb(magnitude, 1'000'000'000);
+            for (int i = 0; i < 9 && (chunk || !magnitude.empty()); ++i) {
+                result += static_cast<char>('0' + chunk % 10);
+                chunk /= 10;
+            }
+        }
+        if (m_negative)
+            result += '-';
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    bool is_zero() const { return m_limbs.empty(); }
+    bool is_negative() const { return m_negative; }
+
+    bool fits_long() const
+    {
+        if (m_limbs.size() > 2)
+            return false;
+        auto magnitude = magnitude_as_unsigned_long();
+        return magnitude <= static_cast<unsigned long>(LONG_MAX) || (m_negative && magnitude == static_cast<unsigned long>(LONG_MAX) + 1);
+    }
+
+    long to_long() const
+    {
+        assert(fits_long());
+        auto magnitude = magnitude_as_unsigned_long();
+        return m_negative ? static_cast<long>(0UL - magnitude) : static_cast<long>(magnitude);
+    }
+
+    double to_double() const
+    {
+        double result = 0;
+        for (auto it = m_limbs.rbegin(); it != m_limbs.rend(); ++it)
+            result = result * 4294967296.0 + *it;
+        return m_negative ? -result : result;
+    }
+
+    std::size_t hash() const
+    {
+        std::size_t result = m_negative;
+        for (auto limb : m_limbs)
+            result = result * 31 + std::hash<Limb> {}(limb);
+        return result;
+    }
+
+    // <0, 0 or >0, like strcmp.
+    int compare(BigInteger const& other) const
+    {
+        if (m_negative != other.m_negative)
+            return m_negative ? -1 : 1;
+        auto order = compare_magnitudes(m_limbs, other.m_limbs);
+        return m_negative ? -order : order;
+    }
+
+    friend bool operator==(BigInteger const& lhs, BigInteger const& rhs) { return lhs.m_negative == rhs.m_negative && lhs.m_limbs == rhs.m_limbs; }
+
+    BigInteger operator-() const
+    {
+        auto result = *this;
+        result.m_negative = !m_negative && !m_limbs.empty();
+        return result;
+    }
+
+    friend BigInteger operator+(BigInteger const& lhs, BigInteger const& rhs)
+    {
+        if (lhs.m_negative == rhs.m_negative)
+            return { lhs.m_negative, add_magnitudes(lhs.m_limbs, rhs.m_limbs) };
+        // Opposite signs: subtract the smaller magnitude from the larger, which decides the sign.
+        if (compare_magnitudes(lhs.m_limbs, rhs.m_limbs) >= 0)
+            return { lhs.m_negative, subtract_magnitudes(lhs.m_limbs, rhs.m_limbs) };
+        return { rhs.m_negative, subtract_magnitudes(rhs.m_limbs, lhs.m_limbs) };
+    }
+
+    friend BigInteger operator-(BigInteger const& lhs, BigInteger const& rhs) { return lhs + -rhs; }
+
+    friend BigInteger operator*(BigInteger const& lhs, BigInteger const& rhs)
+    {
+        return { lhs.m_negative != rhs.m_negative, multiply_magnitudes(lhs.m_limbs, rhs.m_limbs) };
+    }
+
+    // rhs must not be zero.
+    friend BigInteger operator/(BigInteger const& lhs, BigInteger const& rhs)
+    {
+        assert(!rhs.is_zero());
+        return { lhs.m_negative != rhs.m_negative, divide_magnitudes(lhs.m_limbs, rhs.m_limbs) };
+    }
+
+private:
+    BigInteger(bool negative, Magnitude limbs)
+        : m_limbs(std::move(limbs))
+    {
+        trim(m_limbs);
+        m_negative = negative && !m_limbs.empty();
+    }
+
+    unsigned long magnitude_as_unsigned_long() const
+    {
+        unsigned long result = 0;
+        for (std::size_t i = m_limbs.size(); i-- > 0;)
+            result = (result << limb_bits) | m_limbs[i];
+        return result;
+    }
+
+    static void trim(Magnitude& magnitude)
+    {
+        while (!magnitude.empty() && magnitude.back() == 0)
+            magnitude.pop_back();
+    }
+
+    static int compare_magnitudes(Magnitude const& lhs, Magnitude const& rhs)
+    {
+        if (lhs.size() != rhs.size())
+            return lhs.size() < rhs.size() ? -1 : 1;
+        for (std::size_t i = lhs.size(); i-- > 0;) {
+            if (lhs[i] != rhs[i])
+                return lhs[i] < rhs[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    static Magnitude add_magnitudes(Magnitude const& lhs, Magnitude const& rhs)
+    {
+        auto const& longer = lhs.size() >= rhs.size() ? lhs : rhs;
+        auto const& shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+        Magnitude result(longer.size() + 1);
+        DoubleLimb carry = 0;
+        for (std::size_t i = 0; i < longer.size(); ++i) {
+            carry += static_cast<DoubleLimb>(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+            result[i] = static_cast<Limb>(carry);
+            carry >>= limb_bits;
+        }
+        result[longer.size()] = static_cast<Limb>(carry);
+        trim(result);
+        return result;
+    }
+
+    // lhs must not be smaller than rhs.
+    static Magnitude subtract_magnitudes(Magnitude const& lhs, Magnitude const& rhs)
+    {
+        Magnitude result(lhs.size());
+        Limb borrow = 0;
+        for (std::size_t i = 0; i < lhs.size(); ++i) {
+            auto subtrahend = static_cast<DoubleLimb>(i < rhs.size() ? rhs[i] : 0) + borrow;
+            borrow = lhs[i] < subtrahend;
+            result[i] = static_cast<Limb>(lhs[i] - subtrahend);
+        }
+        assert(borrow == 0);
+        trim(result);
+        return result;
+    }
+
+    // Adds addend * 2^(32 * shift) to result, which must have room for it.
+    static void add_shifted(Magnitude& result, Magnitude const& addend, std::size_t shift)
+    {
+        DoubleLimb carry = 0;
+        std::size_t i = 0;
+        for (; i < addend.size() || carry; ++i) {
+            carry += static_cast<DoubleLimb>(result[shift + i]) + (i < addend.size() ? addend[i] : 0);
+            result[shift + i] = static_cast<Limb>(carry);
+            carry >>= limb_bits;
+        }
+    }
+
+    static Magnitude multiply_schoolbook(Magnitude const& lhs, Magnitude const& rhs)
+    {
+        Magnitude result(lhs.size() + rhs.size());
+        for (std::size_t i = 0; i < lhs.size(); ++i) {
+            DoubleLimb carry = 0;
+            for (std::size_t j = 0; j < rhs.size(); ++j) {
+                carry += static_cast<DoubleLimb>(lhs[i]) * rhs[j] + result[i + j];
+                result[i + j] = static_cast<Limb>(carry);
+                carry >>= limb_bits;
+            }
+            result[i + rhs.size()] = static_cast<Limb>(carry);
+        }
+        trim(result);
+        return result;
+    }
+
+    // With lhs = high * B + low and likewise for rhs (B = 2^(32 * half)), three half-size products suffice:
+    // high * high, low * low and (high + low) * (high + low), from which the middle term is recovered.
+    static Magnitude multiply_magnitudes(Magnitude const& lhs, Magnitude const& rhs)
+    {
+        if (std::min(lhs.size(), rhs.size()) < karatsuba_threshold)
+            return multiply_schoolbook(lhs, rhs);
+
+        auto half = std::max(lhs.size(), rhs.size()) / 2;
+        auto split = [half](Magnitude const& magnitude) {
+            auto middle = magnitude.begin() + std::min(half, magnitude.size());
+            Magnitude low(magnitude.begin(), middle);
+            Magnitude high(middle, magnitude.end());
+            trim(low);
+            return std::pair { low, high };
+        };
+        auto [lhs_low, lhs_high] = split(lhs);
+        auto [rhs_low, rhs_high] = split(rhs);
+
+        auto low = multiply_magnitudes(lhs_low, rhs_low);
+        auto high = multiply_magnitudes(lhs_high, rhs_high);
+        auto middle = multiply_magnitudes(add_magnitudes(lhs_low, lhs_high), add_magnitudes(rhs_low, rhs_high));
+        middle = subtract_magnitudes(subtract_magnitudes(middle, low), high);
+
+        Magnitude result(lhs.size() + rhs.size() + 1);
+        add_shifted(result, low, 0);
+        add_shifted(result, middle, half);
+        add_shifted(result, high, 2 * half);
+        trim(result);
+        return result;
+    }
+
+    // magnitude = magnitude * factor + addend.
+    static void multiply_add(Magnitude& magnitude, Limb factor, Limb addend)
+    {
+        DoubleLimb carry = addend;
+        for (auto& limb : magnitude) {
+            carry += static_cast<DoubleLimb>(limb) * factor;
+            limb = static_cast<Limb>(carry);
+            carry >>= limb_bits;
+        }
+        if (carry)
+            magnitude.push_back(static_cast<Limb>(carry));
+    }
+
+    // Divides magnitude in place, and returns the remainder.
+    static Limb divide_by_limb(Magnitude& magnitude, Limb divisor)
+    {
+        DoubleLimb remainder = 0;
+        for (std::size_t i = magnitude.size(); i-- > 0;) {
+            auto dividend = (remainder << limb_bits) | magnitude[i];
+            magnitude[i] = static_cast<Limb>(dividend / divisor);
+            remainder = dividend % divisor;
+        }
+        trim(magnitude);
+        return static_cast<Limb>(remainder);
+    }
+
+    // Knuth, TAOCP vol. 2, 4.3.1, algorithm D: one quotient limb per step, estimated from the top limbs
+    // of the remainder and of the divisor, which is first shifted so that its top bit is set.
+    static Magnitude divide_magnitudes(Magnitude const& dividend, Magnitude const& divisor)
+    {
+        if (compare_magnitudes(dividend, divisor) < 0)
+            return {};
+        if (divisor.size() == 1) {
+            auto quotient = dividend;
+            divide_by_limb(quotient, divisor[0]);
+            return quotient;
+        }
+
+        auto shift = std::countl_zero(divisor.back());
+        auto shifted = [shift](Magnitude const& magnitude, std::size_t size) {
+            Magnitude result(size);
+            for (std::size_t i = 0; i < magnitude.size(); ++i) {
+                auto wide = static_cast<DoubleLimb>(magnitude[i]) << shift;
+                result[i] |= static_cast<Limb>(wide);
+                if (i + 1 < size)
+                    result[i + 1] |= static_cast<Limb>(wide >> limb_bits);
+            }
+            return result;
+        };
+        auto n = divisor.size();
+        auto m = dividend.size() - n;
+        auto v = shifted(divisor, n);
+        auto u = shifted(dividend, dividend.size() + 1);
+        constexpr DoubleLimb base = DoubleLimb { 1 } << limb_bits;
+
+        Magnitude quotient(m + 1);
+        for (std::size_t j = m + 1; j-- > 0;) {
+            auto top = (static_cast<DoubleLimb>(u[j + n]) << limb_bits) | u[j + n - 1];
+            auto estimate = top / v[n - 1];
+            auto remainder = top % v[n - 1];
+            while (estimate >= base || estimate * v[n - 2] > ((remainder << limb_bits) | u[j + n - 2])) {
+                --estimate;
+                remainder += v[n - 1];
+                if (remainder >= base)
+                    break;
+            }
+
+            // u[j .. j + n] -= estimate * v.
+            std::int64_t borrow = 0;
+            DoubleLimb carry = 0;
+            for (std::size_t i = 0; i < n; ++i) {
+                auto product = estimate * v[i] + carry;
+                carry = product >> limb_bits;
+                auto difference = static_cast<std::int64_t>(u[i + j]) - borrow - static_cast<std::int64_t>(product & 0xffffffff);
+                u[i + j] = static_cast<Limb>(difference);
+                borrow = difference < 0;
+            }
+            auto difference = static_cast<std::int64_t>(u[j + n]) - borrow - static_cast<std::int64_t>(carry);
+            u[j + n] = static_cast<Limb>(difference);
+
+            if (difference < 0) {
+                // The estimate was one too large (rare): add the divisor back.
+                --estimate;
+                DoubleLimb add_carry = 0;
+                for (std::size_t i = 0; i < n; ++i) {
+                    add_carry += static_cast<DoubleLimb>(u[i + j]) + v[i];
+                    u[i + j] = static_cast<Limb>(add_carry);
+                    add_carry >>= limb_bits;
+                }
+                u[j + n] += static_cast<Limb>(add_carry);
+            }
+            quotient[j] = static_cast<Limb>(estimate);
+        }
+        trim(quotient);
+        return quotient;
+    }
+
+    bool m_negative { false };
+    Magnitude m_limbs;
+};
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "thread_local_heap.h"
+
+class MalType;
+
+// The queue of a chan: a bounded multi-producer multi-consumer ring of cells (Dmitry Vyukov's algorithm).
+// A put or a take claims a position by a compare-and-swap on the put or take counter, and the sequence
+// number of the cell at that position tells whether the cell is free to fill or full to empty, so no
+// lock is taken and producers and consumers only contend among themselves. close() sets a bit of the
+// put counter, so that a put either claims its position before the channel closes or sees it closed.
+//
+// put() and take() retry for a while when the channel is full or empty, and then sleep on a counter of
+// changes until another thread takes or puts something; the counter is only bumped when a thread sleeps
+// on it, so a channel that keeps up costs no system calls. select() does the same for alts!!, which
+// waits on several channels at once, with one counter for all channels.
+class Channel {
+public:
+    // A value, with the region it was copied into if it was sent from an isolate (see core.cpp's >!!).
+    struct Message {
+        MalType* value;
+        ThreadLocalHeap::Region* region;
+    };
+
+    enum class Result {
+        Done,
+        NotReady,
+        Closed
+    };
+
+    // The capacity is rounded up to a power of two, of at least 2.
+    explicit Channel(std::size_t capacity)
+        : m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+        , m_cells(std::make_unique<Cell[]>(m_mask + 1))
+    {
+        for (std::size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    std::size_t capacity() const { return m_mask + 1; }
+    bool is_closed() const { return m_put_position.load(std::memory_order_acquire) & closed_bit; }
+
+    Result try_put(Message message)
+    {
+        auto position = m_put_position.load(std::memory_order_relaxed);
+        while (true) {
+            if (position & closed_bit)
+                return Result::Closed;
+            auto& cell = m_cells[position & m_mask];
+            auto difference = static_cast<std::intptr_t>(cell.sequence.load(std::memory_order_acquire) - position);
+            if (difference < 0)
+                return Result::NotReady;
+            if (difference > 0) {
+                position = m_put_position.load(std::memory_order_relaxed);
+            } else if (m_put_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.message = message;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                changed();
+                return Result::Done;
+            }
+        }
+    }
+
+    // Closed once the channel is closed and every value put before is taken.
+    Result try_take(Message& message)
+    {
+        auto position = m_take_position.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = m_cells[position & m_mask];
+            auto difference = static_cast<std::intptr_t>(cell.sequence.load(std::memory_order_acquire) - (position + 1));
+            if (difference < 0) {
+                // A put may have claimed the position without having filled the cell yet.
+                auto put_position = m_put_position.load(std::memory_order_acquire);
+                return put_position == (position | closed_bit) ? Result::Closed : Result::NotReady;
+            }
+            if (difference > 0) {
+                position = m_take_position.load(std::memory_order_relaxed);
+            } else if (m_take_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                message = cell.message;
+                cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                changed();
+                return Result::Done;
+            }
+        }
+    }
+
+    Result put(Message message)
+    {
+        return wait_until([&] { return try_put(message); });
+    }
+
+    Result take(Message& message)
+    {
+        return wait_until([&] { return try_take(message); });
+    }
+
+    void close()
+    {
+        m_put_position.fetch_or(closed_bit, std::memory_order_acq_rel);
+        changed();
+    }
+
+    // Calls try_all until it returns true, sleeping until any channel changes when it has returned false
+    // a few times.
+    template<typename TryAll>
+    static void select(TryAll try_all)
+    {
+        for (std::size_t i = 0; i < spin_count; ++i) {
+            if (try_all())
+                return;
+            std::this_thread::yield();
+        }
+        while (true) {
+            auto seen = register_waiter(s_selecting, s_changes);
+            bool done = try_all();
+            if (!done)
+                s_changes.wait(seen, std::memory_order_acquire);
+            s_selecting.fetch_sub(1, std::memory_order_relaxed);
+            if (done)
+                return;
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        Message message;
+    };
+
+    static constexpr std::size_t closed_bit = std::size_t(1) << (sizeof(std::size_t) * 8 - 1);
+    static constexpr std::size_t spin_count = 64;
+
+    template<typename TryOnce>
+    Result wait_until(TryOnce try_once)
+    {
+        for (std::size_t i = 0; i < spin_count; ++i) {
+            auto result = try_once();
+            if (result != Result::NotReady)
+                return result;
+            std::this_thread::yield();
+        }
+        while (true) {
+            auto seen = register_waiter(m_waiting, m_changes);
+            auto result = try_once();
+            if (result == Result::NotReady)
+                m_changes.wait(seen, std::memory_order_acquire);
+            m_waiting.fetch_sub(1, std::memory_order_relaxed);
+            if (result != Result::NotReady)
+                return result;
+        }
+    }
+
+    // A waiter counts itself, then reads the changes counter, then tries once more before sleeping; a
+    // thread that changes the channel changes it, then reads the count. With a full fence between the two
+    // steps on both sides, either the waiter's last try sees the change or the changer sees the waiter.
+    static std::uint32_t register_waiter(std::atomic<std::size_t>& waiting, std::atomic<std::uint32_t>& changes)
+    {
+        waiting.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return changes.load(std::memory_order_acquire);
+    }
+
+    void changed()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed) > 0) {
+            m_changes.fetch_add(1, std::memory_order_release);
+            m_changes.notify_all();
+        }
+        if (s_selecting.load(std::memory_order_relaxed) > 0) {
+            s_changes.fetch_add(1, std::memory_order_release);
+            s_changes.notify_all();
+        }
+    }
+
+    std::size_t const m_mask;
+    std::unique_ptr<Cell[]> const m_cells;
+    // On cache lines of their own, as producers write the one and consumers the other.
+    alignas(64) std::atomic<std::size_t> m_put_position { 0 };
+    alignas(64) std::atomic<std::size_t> m_take_position { 0 };
+    alignas(64) std::atomic<std::size_t> m_waiting { 0 };
+    std::atomic<std::uint32_t> m_changes { 0 };
+
+    static inline std::atomic<std::size_t> s_selecting { 0 };
+    static inline std::atomic<std::uint32_t> s_changes { 0 };
+};
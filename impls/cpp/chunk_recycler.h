@@ -0,0 +1,196 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The number of pauses of each length, in buckets that double in width: bucket 0 counts pauses under
+// 1 us, bucket i > 0 those from 2^(i-1) us to under 2^i us, and the last bucket everything longer.
+// The ChunkRecycler records the time a thread spends handing a region over, which is the only pause
+// reclaiming memory costs here: there is no collector that traces values, whose pauses it could count.
+class PauseHistogram {
+public:
+    static constexpr std::size_t bucket_count = 24;
+
+    void record(std::chrono::steady_clock::duration pause)
+    {
+        auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(pause).count();
+        auto bucket = std::min<std::size_t>(std::bit_width(static_cast<std::uint64_t>(microseconds)), bucket_count - 1);
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::array<std::uint64_t, bucket_count> counts() const
+    {
+        std::array<std::uint64_t, bucket_count> counts;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        return counts;
+    }
+
+    // The upper bound, in microseconds, of the bucket the longest pause falls in, or 0 if there was none.
+    static std::uint64_t longest(std::array<std::uint64_t, bucket_count> const& counts)
+    {
+        for (auto i = bucket_count; i > 0; --i) {
+            if (counts[i - 1] > 0)
+                return std::uint64_t(1) << (i - 1);
+        }
+        return 0;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> m_buckets {};
+};
+
+// Where the memory of destroyed regions goes (see ThreadLocalHeap::Region). Freeing a region's chunks on
+// the spot would stop the thread destroying it for as long as returning every chunk to the system
+// takes, some 100 ms for a 1 GB region; instead the region hands its chunks over in one step and a
+// sweeper thread deals with them later. The sweeper keeps some standard-size chunks, 64 MB by default,
+// for new regions and thread buffers to reuse, already paged in, and frees the rest a few at a time.
+// This only makes freeing a region cheap for the thread that does it. It is not a garbage collector:
+// values outside isolate regions are never freed, and a region's memory is reclaimed as a whole, live
+// values and garbage alike, when its isolate and Handles are gone.
+class ChunkRecycler {
+public:
+    struct Chunk {
+        void* memory;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t chunk_size = 256 * 1024;
+    static constexpr std::size_t default_max_pooled_chunks = 256;
+
+    // Never destroyed, like the WorkStealingPool, so that exiting does not wait for the sweeper.
+    static ChunkRecycler& instance()
+    {
+        static auto* s_instance = new ChunkRecycler;
+        return *s_instance;
+    }
+
+    // A chunk of chunk_size bytes.
+    void* acquire()
+    {
+        {
+            std::lock_guard lock { m_mutex };
+            if (!m_pooled.empty()) {
+                auto* chunk = m_pooled.back();
+                m_pooled.pop_back();
+                return chunk;
+            }
+        }
+        return ::operator new(chunk_size);
+    }
+
+    // Takes chunks over. A few are pooled or freed on the spot, as the region of a message sent on a
+    // channel is, and more are left to the sweeper untouched; the time it takes is recorded as a pause.
+    void release(std::vector<Chunk>&& chunks)
+    {
+        if (chunks.empty())
+            return;
+        auto start = std::chrono::steady_clock::now();
+        if (chunks.size() <= sweep_batch) {
+            recycle(chunks.data(), chunks.data() + chunks.size());
+        } else {
+            std::call_once(m_sweeper_started, [this] { std::thread([this] { sweep(); }).detach(); });
+            {
+                std::lock_guard lock { m_mutex };
+                m_released.push_back(std::move(chunks));
+            }
+            m_sweep.notify_one();
+        }
+        m_pauses.record(std::chrono::steady_clock::now() - start);
+    }
+
+    PauseHistogram const& pauses() const { return m_pauses; }
+
+    std::size_t pooled_chunks()
+    {
+        std::lock_guard lock { m_mutex };
+        return m_pooled.size();
+    }
+
+    // With 0, every chunk is given back to the system once the sweeper gets to it, so that the memory a
+    // process keeps follows the memory its regions hold (see Isolate::Handle), at the cost of reuse.
+    void set_max_pooled_chunks(std::size_t max_pooled_chunks)
+    {
+        std::vector<void*> to_free;
+        {
+            std::lock_guard lock { m_mutex };
+            m_max_pooled_chunks = max_pooled_chunks;
+            while (m_pooled.size() > m_max_pooled_chunks) {
+                to_free.push_back(m_pooled.back());
+                m_pooled.pop_back();
+            }
+        }
+        for (auto* chunk : to_free)
+            ::operator delete(chunk);
+    }
+
+private:
+    // The sweeper frees this many chunks at a time, so that acquire() never waits long for the lock.
+    static constexpr std::size_t sweep_batch = 16;
+
+    ChunkRecycler() = default;
+
+    // At most sweep_batch chunks, of which only those of chunk_size are worth the lock.
+    void recycle(Chunk* begin, Chunk* end)
+    {
+        std::size_t unpooled = 0;
+        void* to_free[sweep_batch];
+        for (auto* chunk = begin; chunk != end; ++chunk) {
+            if (chunk->size == chunk_size)
+                to_free[unpooled++] = chunk->memory;
+            else
+                ::operator delete(chunk->memory);
+        }
+        if (unpooled == 0)
+            return;
+        {
+            std::lock_guard lock { m_mutex };
+            while (unpooled > 0 && m_pooled.size() < m_max_pooled_chunks)
+                m_pooled.push_back(to_free[--unpooled]);
+        }
+        for (std::size_t i = 0; i < unpooled; ++i)
+            ::operator delete(to_free[i]);
+    }
+
+    void sweep()
+    {
+#ifdef SCHED_BATCH
+        // Waking the sweeper must not preempt the thread that destroyed the region, which it would on a
+        // busy machine as the sweeper has slept; a batch thread still gets its fair share of time.
+        sched_param parameters {};
+        pthread_setschedparam(pthread_self(), SCHED_BATCH, &parameters);
+#endif
+        while (true) {
+            std::vector<std::vector<Chunk>> released;
+            {
+                std::unique_lock lock { m_mutex };
+                m_sweep.wait(lock, [this] { return !m_released.empty(); });
+                released.swap(m_released);
+            }
+            for (auto& chunks : released) {
+                for (std::size_t i = 0; i < chunks.size(); i += sweep_batch)
+                    recycle(chunks.data() + i, chunks.data() + std::min(i + sweep_batch, chunks.size()));
+            }
+        }
+    }
+
+    std::once_flag m_sweeper_started;
+    std::mutex m_mutex;
+    std::condition_variable m_sweep;
+    std::vector<std::vector<Chunk>> m_released;
+    std::vector<void*> m_pooled;
+    std::size_t m_max_pooled_chunks { default_max_pooled_chunks };
+    PauseHistogram m_pauses;
+};
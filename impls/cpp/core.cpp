@@ -1,71 +1,192 @@
 #include "core.h"
+#include "numeric_kernels.h"
 #include "printer.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <optional>
 
-MalType* add(size_t argc, MalType** argv)
+// Arithmetic and comparisons work on the numeric tower fixnum (MalInteger) < bignum (MalBigInteger) <
+// flonum (MalFloat): both operands are converted to the higher of their two kinds, found by indexing a
+// table with the pair of kinds. An Operation provides the operation on each kind; on longs it returns
+// nothing when the result overflows, and the operation is redone on BigIntegers instead.
+enum NumberKind : size_t {
+    Fixnum,
+    Bignum,
+    Flonum,
+    NotANumber,
+    number_kinds
+};
+
+static NumberKind number_kind(MalType* mal_type)
 {
-    assert(argc == 2);
+    switch (mal_type->type()) {
+    case MalType::Type::Integer: return Fixnum;
+    case MalType::Type::BigInteger: return Bignum;
+    case MalType::Type::Float: return Flonum;
+    default: return NotANumber;
+    }
+}
 
-    auto* a = argv[0];
-    auto* b = argv[1];
+static MalType* expect_number(MalType* mal_type)
+{
+    if (number_kind(mal_type) == NotANumber)
+        throw new MalException("Expected a number, got a " + mal_type->type_as_string() + ".");
+    return mal_type;
+}
+
+static long fixnum(MalType* mal_type)
+{
+    return static_cast<MalInteger*>(mal_type)->value();
+}
+
+template<typename Operation>
+class NumericDispatch {
+public:
+    using Result = typename Operation::Result;
+
+    static Result apply(MalType* a, MalType* b) { return s_table[number_kind(a)][number_kind(b)](a, b); }
+
+private:
+    using Handler = Result (*)(MalType*, MalType*);
+
+    static Result on_fixnums(MalType* a, MalType* b)
+    {
+        if (auto result = Operation::fixnums(fixnum(a), fixnum(b)))
+            return *result;
+        return on_bignums(a, b);
+    }
+
+    static Result on_bignums(MalType* a, MalType* b) { return Operation::bignums(integer_value(a), integer_value(b)); }
+
+    static Result on_flonums(MalType* a, MalType* b) { return Operation::flonums(float_value(a), float_value(b)); }
+
+    static Result on_non_numbers(MalType* a, MalType* b)
+    {
+        expect_number(a);
+        expect_number(b);
+        __builtin_unreachable();
+    }
+
+    static constexpr auto s_table = [] {
+        std::array<std::array<Handler, number_kinds>, number_kinds> table {};
+        constexpr Handler handlers[] { on_fixnums, on_bignums, on_flonums, on_non_numbers };
+        for (size_t a = 0; a < number_kinds; ++a) {
+            for (size_t b = 0; b < number_kinds; ++b)
+                table[a][b] = handlers[std::max(a, b)];
+        }
+        return table;
+    }();
+};
+
+struct Addition {
+    using Result = MalType*;
+    static std::optional<MalType*> fixnums(long a, long b)
+    {
+        long result;
+        if (__builtin_add_overflow(a, b, &result))
+            return {};
+        return new MalInteger(result);
+    }
+    static MalType* bignums(BigInteger const& a, BigInteger const& b) { return make_integer(a + b); }
+    static MalType* flonums(double a, double b) { return new MalFloat(a + b); }
+};
+
+struct Subtraction {
+    using Result = MalType*;
+    static std::optional<MalType*> fixnums(long a, long b)
+    {
+        long result;
+        if (__builtin_sub_overflow(a, b, &result))
+            return {};
+        return new MalInteger(result);
+    }
+    static MalType* bignums(BigInteger const& a, BigInteger const& b) { return make_integer(a - b); }
+    static MalType* flonums(double a, double b) { return new MalFloat(a - b); }
+};
+
+struct Multiplication {
+    using Result = MalType*;
+    static std::optional<MalType*> fixnums(long a, long b)
+    {
+        long result;
+        if (__builtin_mul_overflow(a, b, &result))
+            return {};
+        return new MalInteger(result);
+    }
+    static MalType* bignums(BigInteger const& a, BigInteger const& b) { return make_integer(a * b); }
+    static MalType* flonums(double a, double b) { return new MalFloat(a * b); }
+};
+
+// Integer division truncates; dividing a float by zero gives an infinity or NaN, as in IEEE 754.
+struct Division {
+    using Result = MalType*;
+    static std::optional<MalType*> fixnums(long a, long b)
+    {
+        // LONG_MIN / -1 is the one quotient of two longs that overflows.
+        if (b == 0 || (a == LONG_MIN && b == -1))
+            return {};
+        return new MalInteger(a / b);
+    }
+    static MalType* bignums(BigInteger const& a, BigInteger const& b)
+    {
+        if (b.is_zero())
+            throw new MalException("Divide by zero.");
+        return make_integer(a / b);
+    }
+    static MalType* flonums(double a, double b) { return new MalFloat(a / b); }
+};
 
-    assert(a->type() == MalType::Type::Integer);
-    assert(b->type() == MalType::Type::Integer);
+// Compare is std::less<> and friends; comparing as doubles makes every comparison with NaN false.
+template<typename Compare>
+struct Comparison {
+    using Result = bool;
+    static std::optional<bool> fixnums(long a, long b) { return Compare {}(a, b); }
+    static bool bignums(BigInteger const& a, BigInteger const& b) { return Compare {}(a.compare(b), 0); }
+    static bool flonums(double a, double b) { return Compare {}(a, b); }
+};
 
-    auto a_value = static_cast<MalInteger*>(a)->value();
-    auto b_value = static_cast<MalInteger*>(b)->value();
-    return new MalInteger(a_value + b_value);
+// + and * take any number of arguments, and (+) and (*) are their identities, which fold relies on.
+MalType* add(size_t argc, MalType** argv)
+{
+    if (argc == 0)
+        return new MalInteger(0);
+    auto* result = expect_number(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i)
+        result = NumericDispatch<Addition>::apply(result, argv[i]);
+    return result;
 }
 
 MalType* subtract(size_t argc, MalType** argv)
 {
     assert(argc == 2);
-
-    auto* a = argv[0];
-    auto* b = argv[1];
-
-    auto a_value = static_cast<MalInteger*>(a)->value();
-    auto b_value = static_cast<MalInteger*>(b)->value();
-    return new MalInteger(a_value - b_value);
+    return NumericDispatch<Subtraction>::apply(argv[0], argv[1]);
 }
 
 MalType* multiply(size_t argc, MalType** argv)
 {
-    assert(argc == 2);
-
-    auto* a = argv[0];
-    auto* b = argv[1];
-
-    assert(a->type() == MalType::Type::Integer);
-    assert(b->type() == MalType::Type::Integer);
-
-    auto a_value = static_cast<MalInteger*>(a)->value();
-    auto b_value = static_cast<MalInteger*>(b)->value();
-    return new MalInteger(a_value * b_value);
+    if (argc == 0)
+        return new MalInteger(1);
+    auto* result = expect_number(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i)
+        result = NumericDispatch<Multiplication>::apply(result, argv[i]);
+    return result;
 }
 
 MalType* divide(size_t argc, MalType** argv)
 {
     assert(argc == 2);
-
-    auto* a = argv[0];
-    auto* b = argv[1];
-
-    assert(a->type() == MalType::Type::Integer);
-    assert(b->type() == MalType::Type::Integer);
-
-    auto a_value = static_cast<MalInteger*>(a)->value();
-    auto b_value = static_cast<MalInteger*>(b)->value();
-    return new MalInteger(a_value / b_value);
+    return NumericDispatch<Division>::apply(argv[0], argv[1]);
 }
 
 MalType* list(size_t argc, MalType** argv)
 {
-    auto new_list = new MalList();
-    for (std::size_t i = 0; i < argc; ++i)
-        new_list->push(argv[i]);
-    return new_list;
+    return new MalList(std::span(argv, argc));
 }
 
 MalType* is_list([[maybe_unused]]size_t argc, MalType** argv)
@@ -77,10 +198,32 @@ MalType* is_list([[maybe_unused]]size_t argc, MalType** argv)
         return new MalFalse();
 }
 
+static std::size_t collection_size(MalType* collection)
+{
+    switch (collection->type()) {
+    case MalType::Type::Nil:
+        return 0;
+    case MalType::Type::HashMap:
+        return static_cast<MalHashMap*>(collection)->size();
+    case MalType::Type::SortedMap:
+        return static_cast<MalSortedMap*>(collection)->size();
+    case MalType::Type::SortedSet:
+        return static_cast<MalSortedSet*>(collection)->size();
+    case MalType::Type::HashSet:
+        return static_cast<MalHashSet*>(collection)->size();
+    case MalType::Type::String:
+        return static_cast<MalString*>(collection)->length();
+    case MalType::Type::NumArray:
+        return static_cast<MalNumArray*>(collection)->size();
+    default:
+        return sequence_size(collection);
+    }
+}
+
 MalType* is_empty([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 1);
-    if (static_cast<MalList*>(argv[0])->empty())
+    if (collection_size(argv[0]) == 0)
         return new MalTrue();
     else
         return new MalFalse();
@@ -89,9 +232,257 @@ MalType* is_empty([[maybe_unused]]size_t argc, MalType** argv)
 MalType* count([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 1);
-    if (argv[0]->type() == MalType::Type::Nil)
-        return new MalInteger { 0 };
-    return new MalInteger { static_cast<long int>(static_cast<MalList*>(argv[0])->size()) };
+    return new MalInteger { static_cast<long int>(collection_size(argv[0])) };
+}
+
+MalType* vector(size_t argc, MalType** argv)
+{
+    return new MalVector(std::span(argv, argc));
+}
+
+MalType* is_vector([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::Vector)
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+MalType* nth([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    assert(argv[1]->type() == MalType::Type::Integer);
+    if (argv[0]->type() != MalType::Type::List && argv[0]->type() != MalType::Type::Vector)
+        throw new MalException("nth: a " + argv[0]->type_as_string() + " is not a sequence.");
+    auto index = static_cast<MalInteger*>(argv[1])->value();
+    if (index < 0 || static_cast<std::size_t>(index) >= sequence_size(argv[0]))
+        throw new MalException("nth: index " + std::to_string(index) + " out of range.");
+    return sequence_at(argv[0], index);
+}
+
+// Lists grow at the front, vectors at the back.
+MalType* conj(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::HashSet) {
+        auto* hash_set = static_cast<MalHashSet*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            hash_set = hash_set->conj(argv[i]);
+        return hash_set;
+    }
+    if (argv[0]->type() == MalType::Type::SortedSet) {
+        auto* sorted_set = static_cast<MalSortedSet*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            sorted_set = sorted_set->conj(argv[i]);
+        return sorted_set;
+    }
+    if (argv[0]->type() == MalType::Type::Vector) {
+        auto* vector = static_cast<MalVector*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            vector = vector->conj(argv[i]);
+        return vector;
+    }
+
+    auto* list = static_cast<MalList*>(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i)
+        list = list->cons(argv[i]);
+    return list;
+}
+
+MalType* cons([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    if (argv[1]->type() == MalType::Type::Vector) {
+        auto* new_list = new MalList();
+        new_list->push(argv[0]);
+        for (auto* mal_type : *static_cast<MalVector*>(argv[1]))
+            new_list->push(mal_type);
+        return new_list;
+    }
+    return static_cast<MalList*>(argv[1])->cons(argv[0]);
+}
+
+// The entries of a sorted map are [key value] vectors.
+static MalType* sorted_entry(MalType* sorted, std::pair<MalType*, MalType*> entry)
+{
+    if (sorted->type() == MalType::Type::SortedSet)
+        return entry.first;
+    MalType* elements[] { entry.first, entry.second };
+    return new MalVector(elements);
+}
+
+static MalSortedMap::Map const& sorted_map_of(MalType* sorted)
+{
+    if (sorted->type() == MalType::Type::SortedSet)
+        return static_cast<MalSortedSet*>(sorted)->sorted_map();
+    assert(sorted->type() == MalType::Type::SortedMap);
+    return static_cast<MalSortedMap*>(sorted)->sorted_map();
+}
+
+// Calls visit on what first, last and rest see in a collection that is neither a list, a vector nor a
+// sorted collection, in iteration order, until visit returns false: the [key value] entries of a hash
+// map, the elements of a hash set or the one-character strings of a string. Anything else is an error.
+template<typename Visit>
+static void for_each_element(MalType* collection, char const* builtin, Visit visit)
+{
+    switch (collection->type()) {
+    case MalType::Type::HashMap:
+        for (auto [key, value] : *static_cast<MalHashMap*>(collection)) {
+            MalType* entry[] { key, value };
+            if (!visit(new MalVector(entry)))
+                return;
+        }
+        return;
+    case MalType::Type::HashSet:
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(collection)) {
+            if (!visit(element))
+                return;
+        }
+        return;
+    case MalType::Type::String:
+        for (auto const& character : static_cast<MalString*>(collection)->value()) {
+            if (!visit(new MalString(std::string_view(&character, 1))))
+                return;
+        }
+        return;
+    default:
+        throw new MalException(std::string(builtin) + ": a " + collection->type_as_string() + " is not a sequence.");
+    }
+}
+
+// O(log n) for sorted maps and sets.
+MalType* first([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    switch (argv[0]->type()) {
+    case MalType::Type::Nil:
+        return new MalNil();
+    case MalType::Type::List:
+    case MalType::Type::Vector:
+        return sequence_size(argv[0]) ? sequence_at(argv[0], 0) : new MalNil();
+    case MalType::Type::SortedMap:
+    case MalType::Type::SortedSet:
+        return collection_size(argv[0]) ? sorted_entry(argv[0], *sorted_map_of(argv[0]).begin()) : new MalNil();
+    default: {
+        MalType* element = new MalNil();
+        for_each_element(argv[0], "first", [&element](MalType* next) {
+            element = next;
+            return false;
+        });
+        return element;
+    }
+    }
+}
+
+MalType* last([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    switch (argv[0]->type()) {
+    case MalType::Type::Nil:
+        return new MalNil();
+    case MalType::Type::List:
+    case MalType::Type::Vector: {
+        auto size = sequence_size(argv[0]);
+        return size ? sequence_at(argv[0], size - 1) : new MalNil();
+    }
+    case MalType::Type::SortedMap:
+    case MalType::Type::SortedSet:
+        return collection_size(argv[0]) ? sorted_entry(argv[0], *sorted_map_of(argv[0]).descending()) : new MalNil();
+    default: {
+        MalType* element = new MalNil();
+        for_each_element(argv[0], "last", [&element](MalType* next) {
+            element = next;
+            return true;
+        });
+        return element;
+    }
+    }
+}
+
+// O(1) for lists, which share their storage with the result.
+MalType* rest([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    switch (argv[0]->type()) {
+    case MalType::Type::Nil:
+        return new MalList();
+    case MalType::Type::List:
+        return static_cast<MalList*>(argv[0])->rest();
+    case MalType::Type::Vector: {
+        auto* vector = static_cast<MalVector*>(argv[0]);
+        auto* new_list = new MalList();
+        for (std::size_t i = 1; i < vector->size(); ++i)
+            new_list->push(vector->at(i));
+        return new_list;
+    }
+    case MalType::Type::SortedMap:
+    case MalType::Type::SortedSet: {
+        auto* new_list = new MalList();
+        bool skipped_first = false;
+        for (auto entry : sorted_map_of(argv[0])) {
+            if (skipped_first)
+                new_list->push(sorted_entry(argv[0], entry));
+            skipped_first = true;
+        }
+        return new_list;
+    }
+    default: {
+        auto* new_list = new MalList();
+        bool skipped_first = false;
+        for_each_element(argv[0], "rest", [new_list, &skipped_first](MalType* element) {
+            if (skipped_first)
+                new_list->push(element);
+            skipped_first = true;
+            return true;
+        });
+        return new_list;
+    }
+    }
+}
+
+MalType* hash_map(size_t argc, MalType** argv)
+{
+    assert(argc % 2 == 0);
+    return new MalHashMap(std::span(argv, argc));
+}
+
+MalType* is_map([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::HashMap || argv[0]->type() == MalType::Type::SortedMap)
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+MalType* assoc(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    assert(argc % 2 == 1);
+    if (argv[0]->type() == MalType::Type::HashMap) {
+        auto* hash_map = static_cast<MalHashMap*>(argv[0]);
+        for (std::size_t i = 1; i < argc; i += 2)
+            hash_map = hash_map->assoc(argv[i], argv[i + 1]);
+        return hash_map;
+    }
+    if (argv[0]->type() == MalType::Type::SortedMap) {
+        auto* sorted_map = static_cast<MalSortedMap*>(argv[0]);
+        for (std::size_t i = 1; i < argc; i += 2)
+            sorted_map = sorted_map->assoc(argv[i], argv[i + 1]);
+        return sorted_map;
+    }
+
+    assert(argv[0]->type() == MalType::Type::Vector);
+    auto* vector = static_cast<MalVector*>(argv[0]);
+    for (std::size_t i = 1; i < argc; i += 2) {
+        assert(argv[i]->type() == MalType::Type::Integer);
+        auto index = static_cast<MalInteger*>(argv[i])->value();
+        if (index < 0 || static_cast<std::size_t>(index) > vector->size())
+            throw new MalException("assoc: index " + std::to_string(index) + " out of range.");
+        vector = vector->assoc(index, argv[i + 1]);
+    }
+    return vector;
 }
 
 MalType* is_equal([[maybe_unused]]size_t argc, MalType** argv)
@@ -108,9 +499,7 @@ MalType* is_equal([[maybe_unused]]size_t argc, MalType** argv)
 MalType* is_lt([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 2);
-    auto* a = static_cast<MalInteger*>(argv[0]);
-    auto* b = static_cast<MalInteger*>(argv[1]);
-    if (a->value() < b->value())
+    if (NumericDispatch<Comparison<std::less<>>>::apply(argv[0], argv[1]))
         return new MalTrue();
     else
         return new MalFalse();
@@ -119,9 +508,7 @@ MalType* is_lt([[maybe_unused]]size_t argc, MalType** argv)
 MalType* is_lte([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 2);
-    auto* a = static_cast<MalInteger*>(argv[0]);
-    auto* b = static_cast<MalInteger*>(argv[1]);
-    if (a->value() <= b->value())
+    if (NumericDispatch<Comparison<std::less_equal<>>>::apply(argv[0], argv[1]))
         return new MalTrue();
     else
         return new MalFalse();
@@ -130,9 +517,7 @@ MalType* is_lte([[maybe_unused]]size_t argc, MalType** argv)
 MalType* is_gt([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 2);
-    auto* a = static_cast<MalInteger*>(argv[0]);
-    auto* b = static_cast<MalInteger*>(argv[1]);
-    if (a->value() > b->value())
+    if (NumericDispatch<Comparison<std::greater<>>>::apply(argv[0], argv[1]))
         return new MalTrue();
     else
         return new MalFalse();
@@ -141,9 +526,7 @@ MalType* is_gt([[maybe_unused]]size_t argc, MalType** argv)
 MalType* is_gte([[maybe_unused]]size_t argc, MalType** argv)
 {
     assert(argc >= 2);
-    auto* a = static_cast<MalInteger*>(argv[0]);
-    auto* b = static_cast<MalInteger*>(argv[1]);
-    if (a->value() >= b->value())
+    if (NumericDispatch<Comparison<std::greater_equal<>>>::apply(argv[0], argv[1]))
         return new MalTrue();
     else
         return new MalFalse();
@@ -151,12 +534,13 @@ MalType* is_gte([[maybe_unused]]size_t argc, MalType** argv)
 
 MalType* prn([[maybe_unused]]size_t argc, MalType** argv)
 {
+    std::string line;
     for (size_t i = 0; i < argc; ++i) {
-        std::cout << pr_str(argv[i], true);
+        line += pr_str(argv[i], true);
         if (i + 1 < argc) // Only if it's not the last element
-            std::cout << ' ';
+            line += ' ';
     }
-    std::cout << '\n';
+    print_line(line);
     return new MalNil();
 }
 
@@ -173,21 +557,1176 @@ MalType* pr_str_core([[maybe_unused]]size_t argc, MalType** argv)
 
 MalType* println([[maybe_unused]]size_t argc, MalType** argv)
 {
+    std::string line;
     for (size_t i = 0; i < argc; ++i) {
-        std::cout << pr_str(argv[i], false);
+        line += pr_str(argv[i], false);
         if (i + 1 < argc) // Only if it's not the last element
-            std::cout << ' ';
+            line += ' ';
     }
-    std::cout << '\n';
+    print_line(line);
     return new MalNil();
 }
 
+// Strings are used as they are rather than printed into a copy, so that (str acc x) in a loop builds
+// a rope and stays linear.
+static MalString* as_string(MalType* mal_type)
+{
+    if (mal_type->type() == MalType::Type::String)
+        return static_cast<MalString*>(mal_type);
+    return new MalString(pr_str(mal_type, false));
+}
+
 MalType* str([[maybe_unused]]size_t argc, MalType** argv)
 {
-    std::string result;
+    auto* result = new MalString("");
     for (size_t i = 0; i < argc; ++i)
-        result += pr_str(argv[i], false);
-    return new MalString( result );
+        result = MalString::concat(result, as_string(argv[i]));
+    return result;
+}
+
+MalType* sb_new([[maybe_unused]]size_t argc, [[maybe_unused]]MalType** argv)
+{
+    return new MalStringBuilder();
+}
+
+// Appends what str would make of the arguments.
+MalType* sb_append([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() != MalType::Type::StringBuilder)
+        throw new MalException("sb-append!: expected a string builder, got a " + argv[0]->type_as_string() + ".");
+    auto* builder = static_cast<MalStringBuilder*>(argv[0]);
+    for (size_t i = 1; i < argc; ++i) {
+        if (argv[i]->type() == MalType::Type::String)
+            builder->append(static_cast<MalString*>(argv[i])->value());
+        else
+            builder->append(pr_str(argv[i], false));
+    }
+    return builder;
+}
+
+MalType* sb_to_str([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() != MalType::Type::StringBuilder)
+        throw new MalException("sb->str: expected a string builder, got a " + argv[0]->type_as_string() + ".");
+    return static_cast<MalStringBuilder*>(argv[0])->to_string();
+}
+
+MalType* dissoc(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::SortedMap) {
+        auto* sorted_map = static_cast<MalSortedMap*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            sorted_map = sorted_map->dissoc(argv[i]);
+        return sorted_map;
+    }
+    assert(argv[0]->type() == MalType::Type::HashMap);
+    auto* hash_map = static_cast<MalHashMap*>(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i)
+        hash_map = hash_map->dissoc(argv[i]);
+    return hash_map;
+}
+
+// Returns nullptr if key is not in the map or set.
+static MalType* find_in_collection(MalType* collection, MalType* key)
+{
+    switch (collection->type()) {
+    case MalType::Type::HashMap:
+        return static_cast<MalHashMap*>(collection)->find(key);
+    case MalType::Type::SortedMap:
+        return static_cast<MalSortedMap*>(collection)->find(key);
+    case MalType::Type::SortedSet:
+        return static_cast<MalSortedSet*>(collection)->find(key);
+    case MalType::Type::HashSet:
+        return static_cast<MalHashSet*>(collection)->find(key);
+    default:
+        return nullptr;
+    }
+}
+
+MalType* get([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    if (auto* value = find_in_collection(argv[0], argv[1]))
+        return value;
+    return new MalNil();
+}
+
+MalType* contains([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    if (find_in_collection(argv[0], argv[1]))
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+template<typename Map>
+static MalList* map_keys(Map const& map)
+{
+    auto* new_list = new MalList();
+    for (auto [key, value] : map)
+        new_list->push(key);
+    return new_list;
+}
+
+template<typename Map>
+static MalList* map_vals(Map const& map)
+{
+    auto* new_list = new MalList();
+    for (auto [key, value] : map)
+        new_list->push(value);
+    return new_list;
+}
+
+MalType* keys([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::SortedMap)
+        return map_keys(*static_cast<MalSortedMap*>(argv[0]));
+    assert(argv[0]->type() == MalType::Type::HashMap);
+    return map_keys(*static_cast<MalHashMap*>(argv[0]));
+}
+
+MalType* vals([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::SortedMap)
+        return map_vals(*static_cast<MalSortedMap*>(argv[0]));
+    assert(argv[0]->type() == MalType::Type::HashMap);
+    return map_vals(*static_cast<MalHashMap*>(argv[0]));
+}
+
+MalType* sorted_map(size_t argc, MalType** argv)
+{
+    assert(argc % 2 == 0);
+    MalSortedMap::Map sorted_map;
+    for (std::size_t i = 0; i < argc; i += 2)
+        sorted_map = sorted_map.assoc(argv[i], argv[i + 1]);
+    return new MalSortedMap(sorted_map);
+}
+
+MalType* sorted_set(size_t argc, MalType** argv)
+{
+    MalSortedSet::Map sorted_map;
+    for (std::size_t i = 0; i < argc; ++i)
+        sorted_map = sorted_map.assoc(argv[i], argv[i]);
+    return new MalSortedSet(sorted_map);
+}
+
+MalType* disj(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::HashSet) {
+        auto* hash_set = static_cast<MalHashSet*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            hash_set = hash_set->disj(argv[i]);
+        return hash_set;
+    }
+    assert(argv[0]->type() == MalType::Type::SortedSet);
+    auto* sorted_set = static_cast<MalSortedSet*>(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i)
+        sorted_set = sorted_set->disj(argv[i]);
+    return sorted_set;
+}
+
+MalType* hash_set(size_t argc, MalType** argv)
+{
+    return new MalHashSet(std::span(argv, argc));
+}
+
+MalType* is_set([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::HashSet || argv[0]->type() == MalType::Type::SortedSet)
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+static MalHashSet* as_hash_set(MalType* set, char const* function_name)
+{
+    if (set->type() != MalType::Type::HashSet)
+        throw new MalException(std::string(function_name) + ": expected a hash-set, got a " + set->type_as_string() + ".");
+    return static_cast<MalHashSet*>(set);
+}
+
+// The set operations cost O(n) hash lookups. Each builds its result as a transient, starting from the
+// set that saves the most work.
+MalType* set_union(size_t argc, MalType** argv)
+{
+    if (argc == 0)
+        return new MalHashSet();
+    auto* largest = as_hash_set(argv[0], "union");
+    for (std::size_t i = 1; i < argc; ++i) {
+        if (as_hash_set(argv[i], "union")->size() > largest->size())
+            largest = static_cast<MalHashSet*>(argv[i]);
+    }
+    auto result = largest->hash_map().transient();
+    for (std::size_t i = 0; i < argc; ++i) {
+        if (argv[i] == largest)
+            continue;
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(argv[i]))
+            result.assoc_in_place(element, element);
+    }
+    return new MalHashSet(result.persistent());
+}
+
+MalType* set_intersection(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto* smallest = as_hash_set(argv[0], "intersection");
+    for (std::size_t i = 1; i < argc; ++i) {
+        if (as_hash_set(argv[i], "intersection")->size() < smallest->size())
+            smallest = static_cast<MalHashSet*>(argv[i]);
+    }
+    auto* result = new MalHashSet();
+    for (auto [element, ignored] : *smallest) {
+        bool in_all = true;
+        for (std::size_t i = 0; i < argc && in_all; ++i)
+            in_all = argv[i] == smallest || static_cast<MalHashSet*>(argv[i])->find(element);
+        if (in_all)
+            result->insert(element);
+    }
+    return result;
+}
+
+MalType* set_difference(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto result = as_hash_set(argv[0], "difference")->hash_map().transient();
+    for (std::size_t i = 1; i < argc; ++i) {
+        for (auto [element, ignored] : *as_hash_set(argv[i], "difference"))
+            result.dissoc_in_place(element);
+    }
+    return new MalHashSet(result.persistent());
+}
+
+// A bound of a subseq/rsubseq range: which of <, <=, > and >= the test is, and the key it tests against.
+struct RangeBound {
+    bool lower;
+    bool inclusive;
+    MalType* key;
+};
+
+static RangeBound range_bound(MalType* test, MalType* key)
+{
+    using Builtin = MalType* (*)(size_t, MalType**);
+    if (test->type() == MalType::Type::Function) {
+        auto function = static_cast<MalFunction*>(test)->function_ptr();
+        if (auto* builtin = function.target<Builtin>()) {
+            if (*builtin == is_gt)
+                return { true, false, key };
+            if (*builtin == is_gte)
+                return { true, true, key };
+            if (*builtin == is_lt)
+                return { false, false, key };
+            if (*builtin == is_lte)
+                return { false, true, key };
+        }
+    }
+    throw new MalException("subseq: the test must be one of <, <=, > and >=.");
+}
+
+// (subseq sc test key) or (subseq sc start-test start-key end-test end-key), in ascending order or,
+// for rsubseq, descending. Seeks to the start bound in O(log n), then walks until the end bound.
+static MalType* sorted_range(size_t argc, MalType** argv, bool descending)
+{
+    assert(argc == 3 || argc == 5);
+    auto const& map = sorted_map_of(argv[0]);
+    std::optional<RangeBound> lower;
+    std::optional<RangeBound> upper;
+    for (std::size_t i = 1; i + 1 < argc; i += 2) {
+        auto bound = range_bound(argv[i], argv[i + 1]);
+        (bound.lower ? lower : upper) = bound;
+    }
+
+    auto& start = descending ? upper : lower;
+    auto& stop = descending ? lower : upper;
+    auto it = !start ? (descending ? map.descending() : map.begin())
+        : descending ? map.descending_from(start->key, start->inclusive)
+                     : map.ascending_from(start->key, start->inclusive);
+
+    auto* new_list = new MalList();
+    for (; it != map.end(); ++it) {
+        if (stop) {
+            auto order = MalSortedKeyTraits::compare((*it).first, stop->key);
+            if (descending ? (order < 0 || (order == 0 && !stop->inclusive)) : (order > 0 || (order == 0 && !stop->inclusive)))
+                break;
+        }
+        new_list->push(sorted_entry(argv[0], *it));
+    }
+    return new_list;
+}
+
+MalType* subseq(size_t argc, MalType** argv)
+{
+    return sorted_range(argc, argv, false);
+}
+
+MalType* rsubseq(size_t argc, MalType** argv)
+{
+    return sorted_range(argc, argv, true);
+}
+
+MalType* transient([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::HashMap)
+        return new MalTransientHashMap(*static_cast<MalHashMap*>(argv[0]));
+    assert(argv[0]->type() == MalType::Type::Vector);
+    return new MalTransientVector(*static_cast<MalVector*>(argv[0]));
+}
+
+// Maps take [key value] vectors, or maps whose entries are all added.
+MalType* conj_transient(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::TransientVector) {
+        auto* vector = static_cast<MalTransientVector*>(argv[0]);
+        for (std::size_t i = 1; i < argc; ++i)
+            vector->conj(argv[i]);
+        return vector;
+    }
+
+    assert(argv[0]->type() == MalType::Type::TransientHashMap);
+    auto* hash_map = static_cast<MalTransientHashMap*>(argv[0]);
+    for (std::size_t i = 1; i < argc; ++i) {
+        if (argv[i]->type() == MalType::Type::HashMap) {
+            for (auto [key, value] : *static_cast<MalHashMap*>(argv[i]))
+                hash_map->assoc(key, value);
+            continue;
+        }
+        if (argv[i]->type() != MalType::Type::Vector || static_cast<MalVector*>(argv[i])->size() != 2)
+            throw new MalException("conj!: a map entry must be a [key value] vector.");
+        auto* entry = static_cast<MalVector*>(argv[i]);
+        hash_map->assoc(entry->at(0), entry->at(1));
+    }
+    return hash_map;
+}
+
+MalType* assoc_transient(size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    assert(argc % 2 == 1);
+    if (argv[0]->type() == MalType::Type::TransientHashMap) {
+        auto* hash_map = static_cast<MalTransientHashMap*>(argv[0]);
+        for (std::size_t i = 1; i < argc; i += 2)
+            hash_map->assoc(argv[i], argv[i + 1]);
+        return hash_map;
+    }
+
+    assert(argv[0]->type() == MalType::Type::TransientVector);
+    auto* vector = static_cast<MalTransientVector*>(argv[0]);
+    for (std::size_t i = 1; i < argc; i += 2) {
+        assert(argv[i]->type() == MalType::Type::Integer);
+        auto index = static_cast<MalInteger*>(argv[i])->value();
+        if (index < 0 || static_cast<std::size_t>(index) > vector->size())
+            throw new MalException("assoc!: index " + std::to_string(index) + " out of range.");
+        vector->assoc(index, argv[i + 1]);
+    }
+    return vector;
+}
+
+MalType* persistent_transient([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::TransientHashMap)
+        return static_cast<MalTransientHashMap*>(argv[0])->persistent();
+    assert(argv[0]->type() == MalType::Type::TransientVector);
+    return static_cast<MalTransientVector*>(argv[0])->persistent();
+}
+
+static MalNumArray* as_num_array(MalType* mal_type)
+{
+    if (mal_type->type() != MalType::Type::NumArray)
+        throw new MalException("Expected a num-array, got a " + mal_type->type_as_string() + ".");
+    return static_cast<MalNumArray*>(mal_type);
+}
+
+// The elements of array as doubles, for operations that mix integer and float arrays.
+static std::vector<double> float_elements(MalNumArray const& array)
+{
+    if (array.element_type() == MalNumArray::ElementType::Float)
+        return { array.floats().begin(), array.floats().end() };
+    return { array.integers().begin(), array.integers().end() };
+}
+
+static void check_same_size(MalNumArray const& lhs, MalNumArray const& rhs)
+{
+    if (lhs.size() != rhs.size())
+        throw new MalException("num-arrays of different sizes: " + std::to_string(lhs.size()) + " and " + std::to_string(rhs.size()) + ".");
+}
+
+// An array of longs if every element is a MalInteger, of doubles if any is a MalFloat.
+MalType* num_array([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::NumArray)
+        return argv[0];
+    if (argv[0]->type() != MalType::Type::List && argv[0]->type() != MalType::Type::Vector)
+        throw new MalException("Expected a list, a vector or a num-array, got a " + argv[0]->type_as_string() + ".");
+    auto size = sequence_size(argv[0]);
+    bool has_floats = false;
+    for (std::size_t i = 0; i < size; ++i) {
+        auto* element = sequence_at(argv[0], i);
+        if (element->type() != MalType::Type::Integer && element->type() != MalType::Type::Float)
+            throw new MalException("A num-array holds integers that fit in a long and floats, not a " + element->type_as_string() + ".");
+        has_floats |= element->type() == MalType::Type::Float;
+    }
+    if (has_floats) {
+        std::vector<double> floats(size);
+        for (std::size_t i = 0; i < size; ++i)
+            floats[i] = float_value(sequence_at(argv[0], i));
+        return new MalNumArray(std::move(floats));
+    }
+    std::vector<long> integers(size);
+    for (std::size_t i = 0; i < size; ++i)
+        integers[i] = static_cast<MalInteger*>(sequence_at(argv[0], i))->value();
+    return new MalNumArray(std::move(integers));
+}
+
+MalType* is_num_array([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::NumArray)
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+MalType* num_array_to_vector([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto* array = as_num_array(argv[0]);
+    auto transient = PersistentVector().transient();
+    for (std::size_t i = 0; i < array->size(); ++i)
+        transient.conj_in_place(array->at(i));
+    return new MalVector(transient.persistent());
+}
+
+MalType* asum([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto* array = as_num_array(argv[0]);
+    if (array->element_type() == MalNumArray::ElementType::Float)
+        return new MalFloat(NumericKernels::sum(array->floats()));
+    if (auto sum = NumericKernels::sum(array->integers()))
+        return new MalInteger(*sum);
+    BigInteger sum;
+    for (auto value : array->integers())
+        sum = sum + BigInteger { value };
+    return make_integer(std::move(sum));
+}
+
+// (amap+ array number) adds number to each element, (amap+ array array) adds elementwise.
+MalType* amap_plus([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    auto* array = as_num_array(argv[0]);
+    auto* addend = argv[1];
+    bool integers = array->element_type() == MalNumArray::ElementType::Integer;
+    if (addend->type() == MalType::Type::NumArray) {
+        check_same_size(*array, *static_cast<MalNumArray*>(addend));
+        integers &= static_cast<MalNumArray*>(addend)->element_type() == MalNumArray::ElementType::Integer;
+    } else if (addend->type() != MalType::Type::Float) {
+        if (addend->type() != MalType::Type::Integer)
+            throw new MalException("Cannot add a " + addend->type_as_string() + " to a num-array.");
+    } else {
+        integers = false;
+    }
+
+    if (integers) {
+        std::vector<long> result(array->size());
+        bool added = addend->type() == MalType::Type::NumArray
+            ? NumericKernels::add(array->integers(), static_cast<MalNumArray*>(addend)->integers(), std::span(result))
+            : NumericKernels::add(array->integers(), static_cast<MalInteger*>(addend)->value(), std::span(result));
+        if (!added)
+            throw new MalException("Integer overflow in amap+.");
+        return new MalNumArray(std::move(result));
+    }
+
+    auto lhs = float_elements(*array);
+    std::vector<double> result(lhs.size());
+    if (addend->type() == MalType::Type::NumArray)
+        NumericKernels::add(std::span<double const>(lhs), std::span<double const>(float_elements(*static_cast<MalNumArray*>(addend))), std::span(result));
+    else
+        NumericKernels::add(std::span<double const>(lhs), float_value(addend), std::span(result));
+    return new MalNumArray(std::move(result));
+}
+
+MalType* adot([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    auto* lhs = as_num_array(argv[0]);
+    auto* rhs = as_num_array(argv[1]);
+    check_same_size(*lhs, *rhs);
+    if (lhs->element_type() == MalNumArray::ElementType::Integer && rhs->element_type() == MalNumArray::ElementType::Integer) {
+        if (auto dot = NumericKernels::dot(lhs->integers(), rhs->integers()))
+            return new MalInteger(*dot);
+        BigInteger dot;
+        for (std::size_t i = 0; i < lhs->size(); ++i)
+            dot = dot + BigInteger { lhs->integers()[i] } * BigInteger { rhs->integers()[i] };
+        return make_integer(std::move(dot));
+    }
+    auto lhs_floats = float_elements(*lhs);
+    auto rhs_floats = float_elements(*rhs);
+    return new MalFloat(NumericKernels::dot(std::span<double const>(lhs_floats), std::span<double const>(rhs_floats)));
+}
+
+template<bool is_max>
+static MalType* array_min_max(MalType* mal_type)
+{
+    auto* array = as_num_array(mal_type);
+    if (array->size() == 0)
+        return new MalNil();
+    if (array->element_type() == MalNumArray::ElementType::Float)
+        return new MalFloat(is_max ? NumericKernels::max(array->floats()) : NumericKernels::min(array->floats()));
+    return new MalInteger(is_max ? NumericKernels::max(array->integers()) : NumericKernels::min(array->integers()));
+}
+
+MalType* amin([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    return array_min_max<false>(argv[0]);
+}
+
+MalType* amax([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    return array_min_max<true>(argv[0]);
+}
+
+// (afilter< array threshold): the elements less than threshold, in order.
+MalType* afilter_lt([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    auto* array = as_num_array(argv[0]);
+    auto* threshold = argv[1];
+    if (threshold->type() != MalType::Type::Integer && threshold->type() != MalType::Type::Float)
+        throw new MalException("Cannot compare a num-array with a " + threshold->type_as_string() + ".");
+
+    if (array->element_type() == MalNumArray::ElementType::Float) {
+        std::vector<double> result(array->size());
+        result.resize(NumericKernels::filter_less(array->floats(), float_value(threshold), result.data()));
+        return new MalNumArray(std::move(result));
+    }
+    // For integers, x < t exactly when x < ceil(t).
+    long integer_threshold;
+    if (threshold->type() == MalType::Type::Integer) {
+        integer_threshold = static_cast<MalInteger*>(threshold)->value();
+    } else {
+        auto ceiling = std::ceil(float_value(threshold));
+        if (std::isnan(ceiling))
+            return new MalNumArray(std::vector<long> {});
+        if (ceiling > static_cast<double>(LONG_MAX))
+            return array;
+        integer_threshold = ceiling < static_cast<double>(LONG_MIN) ? LONG_MIN : static_cast<long>(ceiling);
+    }
+    std::vector<long> result(array->size());
+    result.resize(NumericKernels::filter_less(array->integers(), integer_threshold, result.data()));
+    return new MalNumArray(std::move(result));
+}
+
+MalFuture* future_call(std::function<MalType*()> body, WorkStealingPool& pool)
+{
+    auto* future = new MalFuture(pool);
+    pool.submit([future, body = std::move(body)] {
+        // The task may run on a thread that is running an isolate, whose region that thread alone may use.
+        ThreadLocalHeap::Scope global_heap { nullptr };
+        try {
+            future->deliver(body());
+        } catch (MalException* exception) {
+            future->fail(exception);
+        }
+    });
+    return future;
+}
+
+// Runs queued tasks while waiting rather than blocking: the future may be queued behind this very thread.
+static MalType* await_future(MalFuture* future)
+{
+    while (!future->is_realized()) {
+        if (!future->pool().run_one())
+            future->wait_for(std::chrono::milliseconds(1));
+    }
+    return future->value();
+}
+
+MalType* deref([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::Atom)
+        return static_cast<MalAtom*>(argv[0])->value();
+    if (argv[0]->type() != MalType::Type::Future)
+        throw new MalException("Cannot deref a " + argv[0]->type_as_string() + ".");
+    return await_future(static_cast<MalFuture*>(argv[0]));
+}
+
+MalType* is_realized([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() != MalType::Type::Future)
+        throw new MalException("realized? takes a future, not a " + argv[0]->type_as_string() + ".");
+    if (static_cast<MalFuture*>(argv[0])->is_realized())
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+MalType* atom([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    return new MalAtom(argv[0]);
+}
+
+MalType* is_atom([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() == MalType::Type::Atom)
+        return new MalTrue();
+    else
+        return new MalFalse();
+}
+
+static MalAtom* atom_argument(MalType* argument, std::string_view builtin)
+{
+    if (argument->type() != MalType::Type::Atom)
+        throw new MalException(std::string(builtin) + " takes an atom, not a " + argument->type_as_string() + ".");
+    return static_cast<MalAtom*>(argument);
+}
+
+MalType* reset([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    atom_argument(argv[0], "reset!")->reset(argv[1]);
+    return argv[1];
+}
+
+// (reset-vals! atom value) returns [old-value value].
+MalType* reset_vals([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    MalType* values[] { atom_argument(argv[0], "reset-vals!")->reset(argv[1]), argv[1] };
+    return new MalVector(values);
+}
+
+// (swap! atom f args...) sets the atom to (f value args...), calling f again if another thread changed
+// the atom meanwhile.
+static std::pair<MalType*, MalType*> swap_atom(size_t argc, MalType** argv, std::string_view builtin)
+{
+    assert(argc >= 2);
+    auto* atom = atom_argument(argv[0], builtin);
+    if (argv[1]->type() != MalType::Type::Function)
+        throw new MalException(std::string(builtin) + " takes a function, not a " + argv[1]->type_as_string() + ".");
+    auto const& function = static_cast<MalFunction*>(argv[1])->function();
+    // Most swaps take a few arguments, which need no allocation.
+    std::array<MalType*, 4> few_arguments;
+    std::vector<MalType*> many_arguments;
+    auto arguments = std::span(few_arguments).first(std::min(argc - 1, few_arguments.size()));
+    if (argc - 1 > few_arguments.size()) {
+        many_arguments.resize(argc - 1);
+        arguments = many_arguments;
+    }
+    std::copy(argv + 2, argv + argc, arguments.begin() + 1);
+    return atom->swap([&](MalType* value) {
+        arguments[0] = value;
+        return function(arguments.size(), arguments.data());
+    });
+}
+
+MalType* swap(size_t argc, MalType** argv)
+{
+    return swap_atom(argc, argv, "swap!").second;
+}
+
+// (swap-vals! atom f args...) returns [old-value new-value].
+MalType* swap_vals(size_t argc, MalType** argv)
+{
+    auto [old_value, new_value] = swap_atom(argc, argv, "swap-vals!");
+    MalType* values[] { old_value, new_value };
+    return new MalVector(values);
+}
+
+// (compare-and-set! atom old new) sets the atom to new only if its value is equal to old, and tells
+// whether it did. Unlike Clojure, which compares identities, the values are compared as = would, since
+// numbers and strings are not interned here; the value is retried if it changes to an equal one meanwhile.
+MalType* compare_and_set([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 3);
+    auto* atom = atom_argument(argv[0], "compare-and-set!");
+    auto* value = atom->value();
+    while (value == argv[1] || *value == *argv[1]) {
+        if (atom->compare_and_set(value, argv[2]))
+            return new MalTrue();
+    }
+    return new MalFalse();
+}
+
+// (atom-stats atom) returns {:swaps n :retries n}: the swaps done, and the times swap! had to call its
+// function again because another thread changed the atom first.
+MalType* atom_stats([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto statistics = atom_argument(argv[0], "atom-stats")->statistics();
+    MalType* entries[] {
+        MalKeyword::intern(":swaps"), new MalInteger(static_cast<long>(statistics.swaps)),
+        MalKeyword::intern(":retries"), new MalInteger(static_cast<long>(statistics.retries)),
+    };
+    return new MalHashMap(std::span(entries));
+}
+
+// What deep_copy does with the values it cannot copy: functions, atoms and futures, which belong to the
+// isolate that made them.
+enum class Uncopyable {
+    Refuse,
+    Share
+};
+
+// A copy of value in the current heap, made in traversal order, each element before the collection that
+// holds it. Keywords are interned and channels are made on the global heap, so they are shared rather
+// than copied.
+static MalType* deep_copy(MalType* value, Uncopyable uncopyable = Uncopyable::Refuse)
+{
+    auto copy_elements = [uncopyable](auto const& sequence) {
+        std::vector<MalType*> elements;
+        for (auto* element : sequence)
+            elements.push_back(deep_copy(element, uncopyable));
+        return elements;
+    };
+    switch (value->type()) {
+    case MalType::Type::Nil: return new MalNil();
+    case MalType::Type::False: return new MalFalse();
+    case MalType::Type::True: return new MalTrue();
+    case MalType::Type::Integer: return new MalInteger(static_cast<MalInteger*>(value)->value());
+    case MalType::Type::BigInteger: return new MalBigInteger(static_cast<MalBigInteger*>(value)->value());
+    case MalType::Type::Float: return new MalFloat(static_cast<MalFloat*>(value)->value());
+    case MalType::Type::String: return new MalString(static_cast<MalString*>(value)->value());
+    case MalType::Type::Symbol: return new MalSymbol(static_cast<MalSymbol*>(value)->value());
+    case MalType::Type::Keyword:
+    case MalType::Type::Channel:
+        return value;
+    case MalType::Type::List:
+        return new MalList(copy_elements(*static_cast<MalList*>(value)));
+    case MalType::Type::Vector:
+        return new MalVector(copy_elements(*static_cast<MalVector*>(value)));
+    case MalType::Type::HashMap: {
+        std::vector<MalType*> elements;
+        for (auto [key, element] : *static_cast<MalHashMap*>(value)) {
+            elements.push_back(deep_copy(key, uncopyable));
+            elements.push_back(deep_copy(element, uncopyable));
+        }
+        return new MalHashMap(elements);
+    }
+    case MalType::Type::HashSet: {
+        std::vector<MalType*> elements;
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(value))
+            elements.push_back(deep_copy(element, uncopyable));
+        return new MalHashSet(elements);
+    }
+    case MalType::Type::SortedMap: {
+        MalSortedMap::Map sorted_map;
+        for (auto [key, element] : static_cast<MalSortedMap*>(value)->sorted_map())
+            sorted_map = sorted_map.assoc(deep_copy(key, uncopyable), deep_copy(element, uncopyable));
+        return new MalSortedMap(sorted_map);
+    }
+    case MalType::Type::SortedSet: {
+        MalSortedSet::Map sorted_map;
+        for (auto [element, ignored] : static_cast<MalSortedSet*>(value)->sorted_map()) {
+            auto* copy = deep_copy(element, uncopyable);
+            sorted_map = sorted_map.assoc(copy, copy);
+        }
+        return new MalSortedSet(sorted_map);
+    }
+    case MalType::Type::NumArray: {
+        auto* array = static_cast<MalNumArray*>(value);
+        if (array->element_type() == MalNumArray::ElementType::Integer)
+            return new MalNumArray(std::vector<long>(array->integers().begin(), array->integers().end()));
+        return new MalNumArray(std::vector<double>(array->floats().begin(), array->floats().end()));
+    }
+    default:
+        if (uncopyable == Uncopyable::Share)
+            return value;
+        throw new MalException("Cannot send a " + value->type_as_string() + " out of an isolate.");
+    }
+}
+
+// A value sent from an isolate may be taken after the isolate is gone, so it is copied into a region of
+// its own, which goes with it through the channel. An isolate that takes it copies it again if it fits in
+// the region's first chunk, which is then freed, and adopts the region otherwise, as copying a small value
+// costs less than keeping a mostly empty chunk; a thread outside any isolate keeps everything it is
+// given, region included.
+constexpr std::size_t g_message_first_chunk_size = 512;
+
+static Channel::Message make_message(MalType* value)
+{
+    if (!ThreadLocalHeap::current_region())
+        return { value, nullptr };
+    auto* region = new ThreadLocalHeap::Region(g_message_first_chunk_size);
+    try {
+        ThreadLocalHeap::Scope scope { region };
+        return { deep_copy(value), region };
+    } catch (...) {
+        delete region;
+        throw;
+    }
+}
+
+static MalType* receive_message(Channel::Message message)
+{
+    auto* region = ThreadLocalHeap::current_region();
+    if (!message.region || !region)
+        return message.value;
+    auto* value = message.value;
+    if (message.region->allocated_bytes() <= g_message_first_chunk_size)
+        value = deep_copy(value);
+    else
+        region->adopt(*message.region);
+    delete message.region;
+    return value;
+}
+
+static MalChannel* channel_argument(MalType* argument, std::string_view builtin)
+{
+    if (argument->type() != MalType::Type::Channel)
+        throw new MalException(std::string(builtin) + " takes a channel, not a " + argument->type_as_string() + ".");
+    return static_cast<MalChannel*>(argument);
+}
+
+static Channel::Message message_argument(MalType* argument, std::string_view builtin)
+{
+    if (argument->type() == MalType::Type::Nil)
+        throw new MalException(std::string(builtin) + ": cannot put nil on a channel.");
+    return make_message(argument);
+}
+
+// (chan) or (chan capacity); the capacity is rounded up to a power of two.
+MalType* chan(size_t argc, MalType** argv)
+{
+    std::size_t capacity = 1;
+    if (argc >= 1) {
+        if (argv[0]->type() != MalType::Type::Integer || static_cast<MalInteger*>(argv[0])->value() < 1)
+            throw new MalException("chan: the capacity must be a positive integer.");
+        capacity = static_cast<MalInteger*>(argv[0])->value();
+    }
+    ThreadLocalHeap::Scope global_heap { nullptr };
+    return new MalChannel(capacity);
+}
+
+// (>!! channel value) waits for room, and returns false if the channel is closed. Like <!! and alts!!,
+// it may be used in a future: a pool worker that has to wait gets a spare thread meanwhile (see
+// WorkStealingPool::blocking), so that the future that would end the wait is not stuck behind it.
+MalType* blocking_put([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    auto& channel = channel_argument(argv[0], ">!!")->channel();
+    auto message = message_argument(argv[1], ">!!");
+    auto result = channel.try_put(message);
+    if (result == Channel::Result::NotReady)
+        result = WorkStealingPool::blocking([&] { return channel.put(message); });
+    if (result == Channel::Result::Done)
+        return new MalTrue();
+    delete message.region;
+    return new MalFalse();
+}
+
+// (<!! channel) waits for a value, and returns nil once the channel is closed and empty.
+MalType* blocking_take([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    auto& channel = channel_argument(argv[0], "<!!")->channel();
+    Channel::Message message;
+    auto result = channel.try_take(message);
+    if (result == Channel::Result::NotReady)
+        result = WorkStealingPool::blocking([&] { return channel.take(message); });
+    if (result == Channel::Result::Closed)
+        return new MalNil();
+    return receive_message(message);
+}
+
+MalType* close_channel([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    channel_argument(argv[0], "close!")->channel().close();
+    return new MalNil();
+}
+
+// (alts!! [operation...]) does the first operation that can be done, and returns [value channel]. An
+// operation is a channel, to take from, or a [channel value] vector, to put on; a put returns true, or
+// false if the channel is closed, and a take from a closed channel returns nil. Each call starts
+// trying from the next operation, so that no channel starves the others.
+MalType* alts([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (argv[0]->type() != MalType::Type::Vector && argv[0]->type() != MalType::Type::List)
+        throw new MalException("alts!! takes a vector of operations, not a " + argv[0]->type_as_string() + ".");
+    struct Operation {
+        MalChannel* channel;
+        std::optional<Channel::Message> put;
+    };
+    std::vector<Operation> operations;
+    // The regions of the messages not delivered, which is all of them if an argument is wrong.
+    std::size_t delivered = SIZE_MAX;
+    auto free_undelivered = [&] {
+        for (std::size_t i = 0; i < operations.size(); ++i) {
+            if (operations[i].put && i != delivered)
+                delete operations[i].put->region;
+        }
+    };
+    try {
+        for (std::size_t i = 0; i < sequence_size(argv[0]); ++i) {
+            auto* operation = sequence_at(argv[0], i);
+            if (operation->type() == MalType::Type::Vector && sequence_size(operation) == 2) {
+                auto* channel = channel_argument(sequence_at(operation, 0), "alts!!");
+                operations.push_back({ channel, message_argument(sequence_at(operation, 1), "alts!!") });
+            } else {
+                operations.push_back({ channel_argument(operation, "alts!!"), {} });
+            }
+        }
+    } catch (...) {
+        free_undelivered();
+        throw;
+    }
+    if (operations.empty())
+        throw new MalException("alts!! takes at least one operation.");
+
+    static thread_local std::size_t s_start;
+    auto start = s_start++;
+    MalType* values[2] {};
+    auto try_all = [&] {
+        for (std::size_t i = 0; i < operations.size(); ++i) {
+            auto index = (start + i) % operations.size();
+            auto& operation = operations[index];
+            auto& channel = operation.channel->channel();
+            Channel::Message message;
+            auto result = operation.put ? channel.try_put(*operation.put) : channel.try_take(message);
+            if (result == Channel::Result::NotReady)
+                continue;
+            if (operation.put && result == Channel::Result::Done)
+                delivered = index;
+            if (operation.put)
+                values[0] = result == Channel::Result::Done ? static_cast<MalType*>(new MalTrue()) : new MalFalse();
+            else
+                values[0] = result == Channel::Result::Done ? receive_message(message) : new MalNil();
+            values[1] = operation.channel;
+            return true;
+        }
+        return false;
+    };
+    if (!try_all())
+        WorkStealingPool::blocking([&] { Channel::select(try_all); });
+    free_undelivered();
+    return new MalVector(values);
+}
+
+// (reclaim-pauses) returns {:count n :max-us n :histogram [n...]}: how often, and for how long, threads
+// have stopped to hand the memory of an isolate or a message over to the ChunkRecycler (see
+// chunk_recycler.h), which frees it on a thread of its own. Element i of the histogram counts the pauses
+// under 2^i microseconds and not under half that, and :max-us is the bound of the bucket the longest
+// pause falls in.
+//
+// These are not garbage collection pauses: there is no collector, concurrent or otherwise, and nothing
+// traces or moves live values. The only memory reclaimed is a whole region once its isolate or message
+// is done with it, and what is timed is the hand-off of its chunks, not any freeing of them.
+MalType* reclaim_pauses([[maybe_unused]]size_t argc, [[maybe_unused]]MalType** argv)
+{
+    auto counts = ChunkRecycler::instance().pauses().counts();
+    std::vector<MalType*> histogram;
+    long count = 0;
+    for (auto bucket_count : counts) {
+        histogram.push_back(new MalInteger(static_cast<long>(bucket_count)));
+        count += static_cast<long>(bucket_count);
+    }
+    MalType* entries[] {
+        MalKeyword::intern(":count"), new MalInteger(count),
+        MalKeyword::intern(":max-us"), new MalInteger(static_cast<long>(PauseHistogram::longest(counts))),
+        MalKeyword::intern(":histogram"), new MalVector(histogram),
+    };
+    return new MalHashMap(std::span(entries));
+}
+
+// (compact value) returns a copy of value whose nodes and element arrays sit next to each other in the
+// order a traversal visits them, for long-lived data such as a table built at startup, whose parts are
+// otherwise scattered among everything allocated while it was built. Functions, atoms and futures are
+// shared rather than copied.
+//
+// This is a copy, not a compacting collector: nothing is moved, so value stays valid for whoever holds it,
+// and nothing is freed. The copy goes into the isolate's region, next to value, and both last as long as
+// the isolate does, so compacting costs as much memory again as value takes. Outside an isolate, as in the
+// body of a future, there is no region to put the copy in that would ever be freed, so compact throws
+// there rather than leak one per call. C++ code that keeps a table through an Isolate::Handle can use
+// compact_handle instead (see core.h), which gives the source's region back.
+constexpr std::size_t g_compact_first_chunk_size = 4096;
+
+MalType* compact([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 1);
+    if (!ThreadLocalHeap::current_region())
+        throw new MalException("compact: only runs inside an isolate; C++ code can use compact_handle.");
+    return deep_copy(argv[0], Uncopyable::Share);
+}
+
+Isolate::Handle compact_handle(Isolate::Handle const& handle)
+{
+    return Isolate::make_handle(g_compact_first_chunk_size, [&] { return deep_copy(handle.get()); });
+}
+
+// pmap, pfilter and fold cut their sequence into chunks, run the chunks as futures on a pool and return
+// the chunks' results in order. Unless the caller fixes the chunk size, it adapts to what processing an
+// element costs: the first elements are processed on the calling thread in chunks of 1, 2, 4... elements
+// until probe_time has passed, and the rest are cut into chunks that should take about chunk_time each,
+// long enough that scheduling a chunk costs little beside it. There are at least chunks_per_worker chunks
+// per worker all the same, so that stealing can even out chunks that take longer than others.
+template<typename ProcessChunk>
+static std::vector<MalType*> run_in_chunks(std::size_t size, std::size_t chunk_size, WorkStealingPool& pool, ProcessChunk const& process_chunk)
+{
+    constexpr auto probe_time = std::chrono::microseconds(50);
+    constexpr auto chunk_time = std::chrono::microseconds(200);
+    constexpr std::size_t chunks_per_worker = 4;
+
+    std::vector<MalType*> results;
+    std::size_t begin = 0;
+    if (chunk_size == 0) {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        for (std::size_t probe_size = 1; begin < size && elapsed < probe_time; probe_size *= 2) {
+            auto end = std::min(size, begin + probe_size);
+            results.push_back(process_chunk(begin, end));
+            begin = end;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        if (begin == size)
+            return results;
+        auto element_time = std::chrono::duration<double>(elapsed) / begin;
+        chunk_size = std::max<std::size_t>(chunk_time / element_time, 1);
+        auto chunks = pool.worker_count() * chunks_per_worker;
+        chunk_size = std::min(chunk_size, (size - begin + chunks - 1) / chunks);
+    }
+
+    std::vector<MalFuture*> futures;
+    for (; begin < size; begin += chunk_size) {
+        auto end = std::min(size, begin + chunk_size);
+        futures.push_back(future_call([&process_chunk, begin, end] { return process_chunk(begin, end); }, pool));
+    }
+    // Every chunk has to finish before an exception is rethrown, as they all use process_chunk.
+    MalException* exception = nullptr;
+    for (auto* future : futures) {
+        try {
+            results.push_back(await_future(future));
+        } catch (MalException* chunk_exception) {
+            if (!exception)
+                exception = chunk_exception;
+        }
+    }
+    if (exception)
+        throw exception;
+    return results;
+}
+
+static MalVector* concatenate_chunks(std::vector<MalType*> const& chunks)
+{
+    auto result = PersistentVector().transient();
+    for (auto* chunk : chunks) {
+        for (auto* element : *static_cast<MalVector*>(chunk))
+            result.conj_in_place(element);
+    }
+    return new MalVector(result.persistent());
+}
+
+static bool is_truthy(MalType* mal_type)
+{
+    return mal_type->type() != MalType::Type::Nil && mal_type->type() != MalType::Type::False;
+}
+
+// The chunks store their results straight into place, and have no results of their own.
+MalVector* parallel_map(MalFunctionPtr const& function, MalType* sequence, WorkStealingPool& pool)
+{
+    std::vector<MalType*> results(sequence_size(sequence));
+    run_in_chunks(results.size(), 0, pool, [&](std::size_t begin, std::size_t end) -> MalType* {
+        for (auto i = begin; i < end; ++i) {
+            MalType* arguments[] { sequence_at(sequence, i) };
+            results[i] = function(1, arguments);
+        }
+        return nullptr;
+    });
+    return new MalVector(results);
+}
+
+MalVector* parallel_filter(MalFunctionPtr const& predicate, MalType* sequence, WorkStealingPool& pool)
+{
+    return concatenate_chunks(run_in_chunks(sequence_size(sequence), 0, pool, [&](std::size_t begin, std::size_t end) {
+        auto* chunk = new MalVector();
+        for (auto i = begin; i < end; ++i) {
+            MalType* arguments[] { sequence_at(sequence, i) };
+            if (is_truthy(predicate(1, arguments)))
+                chunk->push(arguments[0]);
+        }
+        return chunk;
+    }));
+}
+
+// Each chunk is reduced from (combine), and the chunks' results are combined left to right, so combine
+// must be associative and (combine) its identity, as with Clojure's reducers.
+MalType* parallel_fold(MalFunctionPtr const& combine, MalFunctionPtr const& reduce, MalType* sequence, std::size_t chunk_size, WorkStealingPool& pool)
+{
+    auto chunks = run_in_chunks(sequence_size(sequence), chunk_size, pool, [&](std::size_t begin, std::size_t end) {
+        auto* result = combine(0, nullptr);
+        for (auto i = begin; i < end; ++i) {
+            MalType* arguments[] { result, sequence_at(sequence, i) };
+            result = reduce(2, arguments);
+        }
+        return result;
+    });
+    if (chunks.empty())
+        return combine(0, nullptr);
+    auto* result = chunks[0];
+    for (std::size_t i = 1; i < chunks.size(); ++i) {
+        MalType* arguments[] { result, chunks[i] };
+        result = combine(2, arguments);
+    }
+    return result;
+}
+
+static MalFunctionPtr function_argument(MalType* argument, std::string_view builtin)
+{
+    if (argument->type() != MalType::Type::Function)
+        throw new MalException(std::string(builtin) + " takes a function, not a " + argument->type_as_string() + ".");
+    return static_cast<MalFunction*>(argument)->function_ptr();
+}
+
+static MalType* sequence_argument(MalType* argument, std::string_view builtin)
+{
+    if (argument->type() != MalType::Type::List && argument->type() != MalType::Type::Vector)
+        throw new MalException(std::string(builtin) + " takes a list or a vector, not a " + argument->type_as_string() + ".");
+    return argument;
+}
+
+MalType* pmap([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    return parallel_map(function_argument(argv[0], "pmap"), sequence_argument(argv[1], "pmap"));
+}
+
+MalType* pfilter([[maybe_unused]]size_t argc, MalType** argv)
+{
+    assert(argc >= 2);
+    return parallel_filter(function_argument(argv[0], "pfilter"), sequence_argument(argv[1], "pfilter"));
+}
+
+// (fold combine reduce sequence), or (fold n combine reduce sequence) for chunks of n elements.
+MalType* fold(size_t argc, MalType** argv)
+{
+    assert(argc >= 3);
+    std::size_t chunk_size = 0;
+    if (argc >= 4) {
+        if (argv[0]->type() != MalType::Type::Integer || static_cast<MalInteger*>(argv[0])->value() < 1)
+            throw new MalException("fold: the chunk size must be a positive integer.");
+        chunk_size = static_cast<MalInteger*>(argv[0])->value();
+        ++argv;
+    }
+    return parallel_fold(function_argument(argv[0], "fold"), function_argument(argv[1], "fold"), sequence_argument(argv[2], "fold"), chunk_size);
 }
 
 CoreFunctionContainer create_core_functions()
@@ -201,6 +1740,36 @@ CoreFunctionContainer create_core_functions()
     core_functions.insert( { new MalSymbol("list?"), new MalFunction (is_list) } );
     core_functions.insert( { new MalSymbol("empty?"), new MalFunction (is_empty) } );
     core_functions.insert( { new MalSymbol("count"), new MalFunction (count) } );
+    core_functions.insert( { new MalSymbol("vector"), new MalFunction (vector) } );
+    core_functions.insert( { new MalSymbol("vector?"), new MalFunction (is_vector) } );
+    core_functions.insert( { new MalSymbol("nth"), new MalFunction (nth) } );
+    core_functions.insert( { new MalSymbol("conj"), new MalFunction (conj) } );
+    core_functions.insert( { new MalSymbol("cons"), new MalFunction (cons) } );
+    core_functions.insert( { new MalSymbol("first"), new MalFunction (first) } );
+    core_functions.insert( { new MalSymbol("last"), new MalFunction (last) } );
+    core_functions.insert( { new MalSymbol("rest"), new MalFunction (rest) } );
+    core_functions.insert( { new MalSymbol("hash-map"), new MalFunction (hash_map) } );
+    core_functions.insert( { new MalSymbol("map?"), new MalFunction (is_map) } );
+    core_functions.insert( { new MalSymbol("assoc"), new MalFunction (assoc) } );
+    core_functions.insert( { new MalSymbol("dissoc"), new MalFunction (dissoc) } );
+    core_functions.insert( { new MalSymbol("get"), new MalFunction (get) } );
+    core_functions.insert( { new MalSymbol("contains?"), new MalFunction (contains) } );
+    core_functions.insert( { new MalSymbol("keys"), new MalFunction (keys) } );
+    core_functions.insert( { new MalSymbol("vals"), new MalFunction (vals) } );
+    core_functions.insert( { new MalSymbol("sorted-map"), new MalFunction (sorted_map) } );
+    core_functions.insert( { new MalSymbol("sorted-set"), new MalFunction (sorted_set) } );
+    core_functions.insert( { new MalSymbol("disj"), new MalFunction (disj) } );
+    core_functions.insert( { new MalSymbol("hash-set"), new MalFunction (hash_set) } );
+    core_functions.insert( { new MalSymbol("set?"), new MalFunction (is_set) } );
+    core_functions.insert( { new MalSymbol("union"), new MalFunction (set_union) } );
+    core_functions.insert( { new MalSymbol("intersection"), new MalFunction (set_intersection) } );
+    core_functions.insert( { new MalSymbol("difference"), new MalFunction (set_difference) } );
+    core_functions.insert( { new MalSymbol("subseq"), new MalFunction (subseq) } );
+    core_functions.insert( { new MalSymbol("rsubseq"), new MalFunction (rsubseq) } );
+    core_functions.insert( { new MalSymbol("transient"), new MalFunction (transient) } );
+    core_functions.insert( { new MalSymbol("conj!"), new MalFunction (conj_transient) } );
+    core_functions.insert( { new MalSymbol("assoc!"), new MalFunction (assoc_transient) } );
+    core_functions.insert( { new MalSymbol("persistent!"), new MalFunction (persistent_transient) } );
     core_functions.insert( { new MalSymbol("="), new MalFunction (is_equal) } );
     core_functions.insert( { new MalSymbol("<"), new MalFunction (is_lt) } );
     core_functions.insert( { new MalSymbol("<="), new MalFunction (is_lte) } );
@@ -210,6 +1779,38 @@ CoreFunctionContainer create_core_functions()
     core_functions.insert( { new MalSymbol("pr-str"), new MalFunction (pr_str_core) } );
     core_functions.insert( { new MalSymbol("println"), new MalFunction (println) } );
     core_functions.insert( { new MalSymbol("str"), new MalFunction (str) } );
+    core_functions.insert( { new MalSymbol("sb-new"), new MalFunction (sb_new) } );
+    core_functions.insert( { new MalSymbol("sb-append!"), new MalFunction (sb_append) } );
+    core_functions.insert( { new MalSymbol("sb->str"), new MalFunction (sb_to_str) } );
+    core_functions.insert( { new MalSymbol("deref"), new MalFunction (deref) } );
+    core_functions.insert( { new MalSymbol("realized?"), new MalFunction (is_realized) } );
+    core_functions.insert( { new MalSymbol("atom"), new MalFunction (atom) } );
+    core_functions.insert( { new MalSymbol("atom?"), new MalFunction (is_atom) } );
+    core_functions.insert( { new MalSymbol("reset!"), new MalFunction (reset) } );
+    core_functions.insert( { new MalSymbol("reset-vals!"), new MalFunction (reset_vals) } );
+    core_functions.insert( { new MalSymbol("swap!"), new MalFunction (swap) } );
+    core_functions.insert( { new MalSymbol("swap-vals!"), new MalFunction (swap_vals) } );
+    core_functions.insert( { new MalSymbol("compare-and-set!"), new MalFunction (compare_and_set) } );
+    core_functions.insert( { new MalSymbol("atom-stats"), new MalFunction (atom_stats) } );
+    core_functions.insert( { new MalSymbol("chan"), new MalFunction (chan) } );
+    core_functions.insert( { new MalSymbol(">!!"), new MalFunction (blocking_put) } );
+    core_functions.insert( { new MalSymbol("<!!"), new MalFunction (blocking_take) } );
+    core_functions.insert( { new MalSymbol("close!"), new MalFunction (close_channel) } );
+    core_functions.insert( { new MalSymbol("alts!!"), new MalFunction (alts) } );
+    core_functions.insert( { new MalSymbol("reclaim-pauses"), new MalFunction (reclaim_pauses) } );
+    core_functions.insert( { new MalSymbol("compact"), new MalFunction (compact) } );
+    core_functions.insert( { new MalSymbol("pmap"), new MalFunction (pmap) } );
+    core_functions.insert( { new MalSymbol("pfilter"), new MalFunction (pfilter) } );
+    core_functions.insert( { new MalSymbol("fold"), new MalFunction (fold) } );
+    core_functions.insert( { new MalSymbol("num-array"), new MalFunction (num_array) } );
+    core_functions.insert( { new MalSymbol("num-array?"), new MalFunction (is_num_array) } );
+    core_functions.insert( { new MalSymbol("num-array->vector"), new MalFunction (num_array_to_vector) } );
+    core_functions.insert( { new MalSymbol("asum"), new MalFunction (asum) } );
+    core_functions.insert( { new MalSymbol("amap+"), new MalFunction (amap_plus) } );
+    core_functions.insert( { new MalSymbol("adot"), new MalFunction (adot) } );
+    core_functions.insert( { new MalSymbol("amin"), new MalFunction (amin) } );
+    core_functions.insert( { new MalSymbol("amax"), new MalFunction (amax) } );
+    core_functions.insert( { new MalSymbol("afilter<"), new MalFunction (afilter_lt) } );
 
     return core_functions;
 }
\ No newline at end of file
@@ -1,7 +1,24 @@
 #pragma once
 
+#include "isolate.h"
 #include "types.h"
+#include "work_stealing_pool.h"
 
 using CoreFunctionContainer = std::unordered_map<MalSymbol*, MalType*, HashMalHashMap, MalHashMapComparator>;
 
-CoreFunctionContainer create_core_functions();
\ No newline at end of file
+CoreFunctionContainer create_core_functions();
+
+// Runs body on pool and returns at once; deref waits for the result. The evaluator's future form uses this.
+MalFuture* future_call(std::function<MalType*()> body, WorkStealingPool& pool = WorkStealingPool::instance());
+
+// A copy of handle's value laid out like (compact value), in a region of its own, for a long-lived table
+// that C++ code keeps from an isolate. Unlike the copy compact makes in mal, this one replaces its source:
+// once handle and its isolate are gone, the source's region is freed, so the table costs one copy rather
+// than two. Functions, atoms and futures cannot be copied out of their region, and make it throw.
+Isolate::Handle compact_handle(Isolate::Handle const& handle);
+
+// The bodies of pmap, pfilter and fold. A chunk_size of 0 lets fold choose one from the cost of reduce.
+MalVector* parallel_map(MalFunctionPtr const& function, MalType* sequence, WorkStealingPool& pool = WorkStealingPool::instance());
+MalVector* parallel_filter(MalFunctionPtr const& predicate, MalType* sequence, WorkStealingPool& pool = WorkStealingPool::instance());
+MalType* parallel_fold(MalFunctionPtr const& combine, MalFunctionPtr const& reduce, MalType* sequence, std::size_t chunk_size = 0,
+    WorkStealingPool& pool = WorkStealingPool::instance());
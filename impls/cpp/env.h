@@ -1,55 +1,121 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <string>
 
+#include "thread_local_heap.h"
 #include "types.h"
 
+// The bindings of an Env are an immutable map, published through an atomic pointer, so that any number
+// of threads may look symbols up while others def! new ones: a lookup reads whichever version is current
+// and never waits, and set() makes an updated copy (sharing all but one path with the old one) and swaps
+// it in with a compare-and-swap, retrying if another set() got there first. Old versions are never freed.
+// Envs and their bindings are allocated like MalType nodes (see ThreadLocalHeap), but for the frames of
+// calls that nothing can keep, which live on the C++ stack (see EVAL's fn*).
 class Env {
 public:
-    Env(Env* outer, MalList* binds = nullptr, MalList* exprs = nullptr)
+    using Bindings = MalHashMap::Map;
+
+    static void* operator new(std::size_t size) { return ThreadLocalHeap::allocate(size); }
+    static void operator delete(void*) noexcept { }
+
+    // binds is a list or a vector of symbols. Arguments past the parameters are ignored, but missing
+    // ones are an error.
+    Env(Env* outer, MalType* binds = nullptr, MalList* exprs = nullptr)
         : m_outer_env(outer)
     {
         if (!binds || !exprs)
             return;
-        for (std::size_t i = 0; i < binds->size(); ++i) {
-            if (binds->at(i)->inspect() == "&") {
-                auto * rest_of_exprs = new MalList();
-                for (std::size_t j = i; j < exprs->size(); ++j)
-                    rest_of_exprs->push(exprs->at(j));
-                set(static_cast<MalSymbol*>(binds->at(i+1)), rest_of_exprs);
+        auto parameter_count = sequence_size(binds);
+        auto variadic = parameter_count >= 2 && sequence_at(binds, parameter_count - 2)->inspect() == "&";
+        auto required = variadic ? parameter_count - 2 : parameter_count;
+        if (exprs->size() < required)
+            throw new MalException(std::string("fn* expects ") + (variadic ? "at least " : "") + std::to_string(required)
+                + " arguments, got " + std::to_string(exprs->size()) + ".");
+        // Not shared yet, so the bindings can be built in place.
+        auto bindings = Bindings().transient();
+        for (std::size_t i = 0; i < parameter_count; ++i) {
+            if (sequence_at(binds, i)->inspect() == "&") {
+                bindings.assoc_in_place(sequence_at(binds, i + 1), exprs->slice(i));
                 break;
             }
-            set(static_cast<MalSymbol*>(binds->at(i)), exprs->at(i));
+            bindings.assoc_in_place(sequence_at(binds, i), exprs->at(i));
         }
+        m_bindings.store(make_bindings(bindings.persistent()), std::memory_order_release);
+    }
+
+    // A call frame that binds parameters to arguments in place, copying neither, for a call whose Env
+    // cannot outlive it (see EVAL's fn*): both arrays must live as long as the Env.
+    Env(Env* outer, std::span<MalSymbol* const> parameters, MalType* const* arguments)
+        : m_outer_env(outer)
+        , m_parameters(parameters.data())
+        , m_arguments(arguments)
+        , m_parameter_count(parameters.size())
+    {
     }
 
     void set(MalSymbol* key, MalType* value)
     {
-        m_data.insert_or_assign(key, value);
+        auto const* bindings = m_bindings.load(std::memory_order_acquire);
+        auto* new_bindings = make_bindings(assoc(*bindings, key, value));
+        while (!m_bindings.compare_exchange_weak(bindings, new_bindings, std::memory_order_release, std::memory_order_acquire))
+            *new_bindings = assoc(*bindings, key, value);
     }
 
     Env* find(MalSymbol* key)
     {
-        auto value = m_data.find(key);
         // takes a symbol key and if the current environment contains that key then return the environment.
-        if (value != m_data.end())
-            return this;
-        // If no key is found and outer is not nil then call find (recurse) on the outer environment.
-        if (m_outer_env)
-            return m_outer_env->find(key);
-
+        // If no key is found and outer is not nil then look in the outer environment.
+        for (auto* env = this; env; env = env->m_outer_env) {
+            if (env->lookup(key))
+                return env;
+        }
         return {};
     }
 
     MalType* get(MalSymbol* key)
     {
-        auto env = find(key);
-        if (env)
-            return env->m_data[key]; // I use [] as we checked in find() that the pair exists.
+        for (auto* env = this; env; env = env->m_outer_env) {
+            if (auto* value = env->lookup(key))
+                return value;
+        }
         throw new MalException("'" + key->inspect() + "'" + " not found.");
     }
 
 private:
-    std::unordered_map<MalSymbol*, MalType*, HashMalHashMap, MalHashMapComparator> m_data;
+    // What def! bound shadows the parameters. An Env that nothing was def!'d in skips the hash lookup.
+    MalType* lookup(MalSymbol* key) const
+    {
+        auto const* bindings = m_bindings.load(std::memory_order_acquire);
+        if (bindings != &s_no_bindings) {
+            if (auto* value = bindings->find(key))
+                return value;
+        }
+        for (std::size_t i = 0; i < m_parameter_count; ++i) {
+            if (m_parameters[i] == key || *m_parameters[i] == *key)
+                return m_arguments[i];
+        }
+        return nullptr;
+    }
+
+    static Bindings* make_bindings(Bindings bindings) { return new (ThreadLocalHeap::allocate(sizeof(Bindings))) Bindings(std::move(bindings)); }
+
+    // s_no_bindings was made before the default memory resource was chosen (see Isolate::initialize()),
+    // so the first binding starts a map of its own, which allocates from the current one.
+    static Bindings assoc(Bindings const& bindings, MalSymbol* key, MalType* value)
+    {
+        if (&bindings == &s_no_bindings)
+            return Bindings().assoc(key, value);
+        return bindings.assoc(key, value);
+    }
+
+    static inline Bindings const s_no_bindings;
+
+    std::atomic<Bindings const*> m_bindings { &s_no_bindings };
     Env* m_outer_env { nullptr };
-};
\ No newline at end of file
+    MalSymbol* const* m_parameters { nullptr };
+    MalType* const* m_arguments { nullptr };
+    std::size_t m_parameter_count { 0 };
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+
+#include "env.h"
+#include "thread_local_heap.h"
+
+// An independent interpreter instance, for running many small scripts in one process: each isolate has
+// a global Env of its own, whose outer Env is the core Env of builtins that every isolate shares, and a
+// Region that all the values it makes come from, which are freed with the isolate. Making one costs an
+// Env and an empty Region, and isolates on different threads share no lock but those of the tables
+// below. Nodes, collection storage, transients' Edits, string buffers and the flat copies of ropes come
+// from the region. What a node keeps in a std::string or std::vector comes from the global heap instead,
+// and is not freed with the region, since a region runs no destructors: the names of symbols over 15
+// characters, the messages of exceptions, the buffers of string builders, the limbs of big integers and
+// the elements of num-arrays. A script that makes many big integers or num-arrays leaks them with each
+// isolate.
+//
+// Shared data is read-only, or made outside any region:
+// - The core Env must be complete before the first isolate is made, and no isolate may def! into it.
+// - Keywords are interned, and reading with ReadMode::HashConsed interns values, on the global heap.
+// - Channels are made on the global heap, and a value sent from an isolate is copied out of its region
+//   (see core.cpp's >!!), so that channels can carry values between isolates.
+// - Work for the WorkStealingPool (future, pmap...) allocates from the global heap of the thread that
+//   runs it, since a region can only be used by one thread at a time. An isolate must therefore not be
+//   destroyed while work it started is still running.
+//
+// Values must not otherwise be passed from one isolate to another, which may outlive the isolate that
+// made them. C++ code that keeps a value after its isolate is gone holds it through a Handle.
+class Isolate {
+    // The region, counting the isolate and its Handles, and freed when the last of them is gone.
+    struct SharedRegion {
+        explicit SharedRegion(std::size_t first_chunk_size = ThreadLocalHeap::chunk_size)
+            : region(first_chunk_size)
+        {
+        }
+
+        ThreadLocalHeap::Region region;
+        std::atomic<std::size_t> references { 1 };
+
+        void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+
+        void release()
+        {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+    };
+
+public:
+    // A value made in an isolate, for C++ code that embeds the interpreter to hold on to: the isolate's
+    // region, which the value and everything it refers to live in, is freed when the isolate and the last
+    // handle are gone, so that the value may outlive the isolate. The count is per region, not per value:
+    // a handle on one small value keeps the whole region, with all the garbage the isolate made, so the
+    // memory kept follows the regions still held rather than the values still reachable (compact_handle
+    // in core.h copies a value into a region of its own to trim it). A region is freed as a whole, so a
+    // closure that refers to its own Env needs no cycle collection. Copying a handle costs an atomic
+    // increment, and the last release hands the region's chunks to the ChunkRecycler rather than freeing
+    // them one by one. Values made from a handle's value outside the isolate must not outlive the handle.
+    class Handle {
+    public:
+        Handle() = default;
+
+        Handle(Handle const& other)
+            : m_value(other.m_value)
+            , m_region(other.m_region)
+        {
+            if (m_region)
+                m_region->retain();
+        }
+
+        Handle(Handle&& other) noexcept
+            : m_value(std::exchange(other.m_value, nullptr))
+            , m_region(std::exchange(other.m_region, nullptr))
+        {
+        }
+
+        Handle& operator=(Handle other) noexcept
+        {
+            std::swap(m_value, other.m_value);
+            std::swap(m_region, other.m_region);
+            return *this;
+        }
+
+        ~Handle()
+        {
+            if (m_region)
+                m_region->release();
+        }
+
+        MalType* get() const { return m_value; }
+        MalType* operator->() const { return m_value; }
+        explicit operator bool() const { return m_value; }
+
+    private:
+        friend class Isolate;
+
+        Handle(MalType* value, SharedRegion* region)
+            : m_value(value)
+            , m_region(region)
+        {
+            m_region->retain();
+        }
+
+        MalType* m_value { nullptr };
+        SharedRegion* m_region { nullptr };
+    };
+
+    // Call once, before making the core Env, so that the collections isolates build come from their regions.
+    static void initialize() { std::pmr::set_default_resource(ThreadLocalHeap::resource()); }
+
+    // The global Env is made in the region too, as the closures made in it refer to it.
+    explicit Isolate(Env& core)
+        : m_region(new SharedRegion)
+        , m_env(make_env(*m_region, core))
+    {
+    }
+
+    Isolate(Isolate const&) = delete;
+    Isolate& operator=(Isolate const&) = delete;
+
+    ~Isolate() { m_region->release(); }
+
+    Env& env() { return *m_env; }
+    ThreadLocalHeap::Region const& region() const { return m_region->region; }
+
+    // A handle on value, which must have been made by this isolate or be shared by all of them. It keeps
+    // the whole region; to keep a small value from an isolate that made a lot of garbage, pass the handle
+    // to compact_handle (see core.h) and drop it, so that only the copy's region stays.
+    Handle keep(MalType* value) { return Handle(value, m_region); }
+
+    // A handle on the value make() returns, made in a region of its own rather than an isolate's, such
+    // as a copy of another handle's value (see compact_handle in core.h). The region starts as small as
+    // first_chunk_size.
+    template<typename Function>
+    static Handle make_handle(std::size_t first_chunk_size, Function&& make)
+    {
+        auto* region = new SharedRegion(first_chunk_size);
+        Handle handle;
+        try {
+            ThreadLocalHeap::Scope scope { &region->region };
+            handle = Handle(std::forward<Function>(make)(), region);
+        } catch (...) {
+            region->release();
+            throw;
+        }
+        region->release();
+        return handle;
+    }
+
+    // Calls function(env()) with the calling thread allocating from this isolate's region. Only one
+    // thread at a time may run an isolate.
+    template<typename Function>
+    decltype(auto) run(Function&& function)
+    {
+        ThreadLocalHeap::Scope scope { &m_region->region };
+        return std::forward<Function>(function)(*m_env);
+    }
+
+private:
+    static Env* make_env(SharedRegion& region, Env& core)
+    {
+        ThreadLocalHeap::Scope scope { &region.region };
+        return new Env(&core);
+    }
+
+    SharedRegion* m_region;
+    Env* m_env { nullptr };
+};
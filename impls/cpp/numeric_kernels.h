@@ -0,0 +1,333 @@
+#pragma once
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Bulk operations over the contiguous longs and doubles of a MalNumArray. Each one has a portable scalar
+// version and an AVX2 version that handles four elements per instruction, compiled with a target
+// attribute so that the rest of the build needs no -mavx2; the public functions pick the AVX2 version
+// when the CPU has it. Off x86-64 there is only the scalar version. Integer operations report overflow
+// instead of wrapping around.
+//
+// Floating-point sums and dot products add in a different order in the two versions, so their last
+// bits may differ.
+class NumericKernels {
+public:
+    static_assert(sizeof(long) == sizeof(std::int64_t));
+
+    static bool has_avx2()
+    {
+#if defined(__x86_64__)
+        static bool const s_has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return s_has_avx2;
+#else
+        return false;
+#endif
+    }
+
+    // Nothing if the sum overflows.
+    static std::optional<long> sum(std::span<long const> values) { return has_avx2() ? avx2_sum(values) : scalar_sum(values); }
+    static double sum(std::span<double const> values) { return has_avx2() ? avx2_sum(values) : scalar_sum(values); }
+
+    // AVX2 has no 64-bit integer multiply, so this one is scalar only. Nothing if it overflows.
+    static std::optional<long> dot(std::span<long const> lhs, std::span<long const> rhs)
+    {
+        long result = 0;
+        for (std::size_t i = 0; i < lhs.size(); ++i) {
+            long product;
+            if (__builtin_mul_overflow(lhs[i], rhs[i], &product) || __builtin_add_overflow(result, product, &result))
+                return {};
+        }
+        return result;
+    }
+
+    static double dot(std::span<double const> lhs, std::span<double const> rhs) { return has_avx2() ? avx2_dot(lhs, rhs) : scalar_dot(lhs, rhs); }
+
+    // out[i] = lhs[i] + rhs[i], or + rhs for a scalar rhs. False if an integer sum overflows.
+    template<typename T, typename Rhs>
+    static bool add(std::span<T const> lhs, Rhs rhs, std::span<T> out) { return has_avx2() ? avx2_add(lhs, rhs, out) : scalar_add(lhs, rhs, out); }
+
+    // values must not be empty.
+    template<typename T>
+    static T min(std::span<T const> values) { return has_avx2() ? avx2_min_max<false>(values) : scalar_min_max<false>(values); }
+    template<typename T>
+    static T max(std::span<T const> values) { return has_avx2() ? avx2_min_max<true>(values) : scalar_min_max<true>(values); }
+
+    // Copies the values less than threshold to out, which must have room for all of them, and returns
+    // how many there were.
+    template<typename T>
+    static std::size_t filter_less(std::span<T const> values, T threshold, T* out)
+    {
+        return has_avx2() ? avx2_filter_less(values, threshold, out) : scalar_filter_less(values, threshold, out);
+    }
+
+    // Sums in 128 bits, so that only a total that does not fit counts as overflow.
+    static std::optional<long> scalar_sum(std::span<long const> values, __int128 result = 0)
+    {
+        for (auto value : values)
+            result += value;
+        if (result < LONG_MIN || result > LONG_MAX)
+            return {};
+        return static_cast<long>(result);
+    }
+
+    static double scalar_sum(std::span<double const> values)
+    {
+        double result = 0;
+        for (auto value : values)
+            result += value;
+        return result;
+    }
+
+    static double scalar_dot(std::span<double const> lhs, std::span<double const> rhs)
+    {
+        double result = 0;
+        for (std::size_t i = 0; i < lhs.size(); ++i)
+            result += lhs[i] * rhs[i];
+        return result;
+    }
+
+    template<typename T, typename Rhs>
+    static bool scalar_add(std::span<T const> lhs, Rhs rhs, std::span<T> out)
+    {
+        for (std::size_t i = 0; i < lhs.size(); ++i) {
+            T addend;
+            if constexpr (std::is_arithmetic_v<Rhs>)
+                addend = rhs;
+            else
+                addend = rhs[i];
+            if constexpr (std::is_integral_v<T>) {
+                if (__builtin_add_overflow(lhs[i], addend, &out[i]))
+                    return false;
+            } else {
+                out[i] = lhs[i] + addend;
+            }
+        }
+        return true;
+    }
+
+    template<bool is_max, typename T>
+    static T scalar_min_max(std::span<T const> values)
+    {
+        auto result = values[0];
+        for (auto value : values) {
+            if (is_max ? result < value : value < result)
+                result = value;
+        }
+        return result;
+    }
+
+    template<typename T>
+    static std::size_t scalar_filter_less(std::span<T const> values, T threshold, T* out)
+    {
+        std::size_t count = 0;
+        for (auto value : values) {
+            // Branch-free: always store, only advance past the values that pass.
+            out[count] = value;
+            count += value < threshold;
+        }
+        return count;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("avx2,fma"))) static std::optional<long> avx2_sum(std::span<long const> values)
+    {
+        // A lane overflowed if both addends have the same sign and the sum does not.
+        auto sum = _mm256_setzero_si256();
+        auto overflow = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 4 <= values.size(); i += 4) {
+            auto value = load(values.data() + i);
+            auto new_sum = _mm256_add_epi64(sum, value);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(new_sum, sum), _mm256_xor_si256(new_sum, value)));
+            sum = new_sum;
+        }
+        // A lane may overflow even if the total does not; let the scalar version decide.
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+            return scalar_sum(values);
+
+        alignas(32) long lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        return scalar_sum(values.subspan(i), __int128 { lanes[0] } + lanes[1] + lanes[2] + lanes[3]);
+    }
+
+    // Four independent accumulators, so that the adds do not wait on each other.
+    __attribute__((target("avx2,fma"))) static double avx2_sum(std::span<double const> values)
+    {
+        __m256d sums[4] { _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd() };
+        std::size_t i = 0;
+        for (; i + 16 <= values.size(); i += 16) {
+            for (std::size_t j = 0; j < 4; ++j)
+                sums[j] = _mm256_add_pd(sums[j], _mm256_loadu_pd(values.data() + i + 4 * j));
+        }
+        for (; i + 4 <= values.size(); i += 4)
+            sums[0] = _mm256_add_pd(sums[0], _mm256_loadu_pd(values.data() + i));
+        auto result = horizontal_sum(_mm256_add_pd(_mm256_add_pd(sums[0], sums[1]), _mm256_add_pd(sums[2], sums[3])));
+        for (; i < values.size(); ++i)
+            result += values[i];
+        return result;
+    }
+
+    __attribute__((target("avx2,fma"))) static double avx2_dot(std::span<double const> lhs, std::span<double const> rhs)
+    {
+        __m256d sums[4] { _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd() };
+        std::size_t i = 0;
+        for (; i + 16 <= lhs.size(); i += 16) {
+            for (std::size_t j = 0; j < 4; ++j)
+                sums[j] = _mm256_fmadd_pd(_mm256_loadu_pd(lhs.data() + i + 4 * j), _mm256_loadu_pd(rhs.data() + i + 4 * j), sums[j]);
+        }
+        for (; i + 4 <= lhs.size(); i += 4)
+            sums[0] = _mm256_fmadd_pd(_mm256_loadu_pd(lhs.data() + i), _mm256_loadu_pd(rhs.data() + i), sums[0]);
+        auto result = horizontal_sum(_mm256_add_pd(_mm256_add_pd(sums[0], sums[1]), _mm256_add_pd(sums[2], sums[3])));
+        for (; i < lhs.size(); ++i)
+            result += lhs[i] * rhs[i];
+        return result;
+    }
+
+    template<typename T, typename Rhs>
+    __attribute__((target("avx2,fma"))) static bool avx2_add(std::span<T const> lhs, Rhs rhs, std::span<T> out)
+    {
+        std::size_t i = 0;
+        if constexpr (std::is_integral_v<T>) {
+            auto overflow = _mm256_setzero_si256();
+            for (; i + 4 <= lhs.size(); i += 4) {
+                auto left = load(lhs.data() + i);
+                __m256i right;
+                if constexpr (std::is_arithmetic_v<Rhs>)
+                    right = _mm256_set1_epi64x(rhs);
+                else
+                    right = load(rhs.data() + i);
+                auto result = _mm256_add_epi64(left, right);
+                overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(result, left), _mm256_xor_si256(result, right)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + i), result);
+            }
+            if (_mm256_movemask_pd(_mm256_castsi256_pd(overflow)))
+                return false;
+        } else {
+            for (; i + 4 <= lhs.size(); i += 4) {
+                __m256d right;
+                if constexpr (std::is_arithmetic_v<Rhs>)
+                    right = _mm256_set1_pd(rhs);
+                else
+                    right = _mm256_loadu_pd(rhs.data() + i);
+                _mm256_storeu_pd(out.data() + i, _mm256_add_pd(_mm256_loadu_pd(lhs.data() + i), right));
+            }
+        }
+        if constexpr (std::is_arithmetic_v<Rhs>)
+            return scalar_add(lhs.subspan(i), rhs, out.subspan(i));
+        else
+            return scalar_add(lhs.subspan(i), rhs.subspan(i), out.subspan(i));
+    }
+
+    template<bool is_max, typename T>
+    __attribute__((target("avx2,fma"))) static T avx2_min_max(std::span<T const> values)
+    {
+        if (values.size() < 4)
+            return scalar_min_max<is_max>(values);
+        alignas(32) T lanes[4];
+        std::size_t i = 4;
+        if constexpr (std::is_integral_v<T>) {
+            // No 64-bit integer min or max before AVX-512: compare, then blend.
+            auto result = load(values.data());
+            for (; i + 4 <= values.size(); i += 4) {
+                auto value = load(values.data() + i);
+                auto replace = is_max ? _mm256_cmpgt_epi64(value, result) : _mm256_cmpgt_epi64(result, value);
+                result = _mm256_blendv_epi8(result, value, replace);
+            }
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), result);
+        } else {
+            auto result = _mm256_loadu_pd(values.data());
+            for (; i + 4 <= values.size(); i += 4) {
+                auto value = _mm256_loadu_pd(values.data() + i);
+                result = is_max ? _mm256_max_pd(value, result) : _mm256_min_pd(value, result);
+            }
+            _mm256_store_pd(lanes, result);
+        }
+        auto result = scalar_min_max<is_max>(std::span<T const>(lanes));
+        for (; i < values.size(); ++i) {
+            if (is_max ? result < values[i] : values[i] < result)
+                result = values[i];
+        }
+        return result;
+    }
+
+    // Compares four values at a time, then moves the ones that pass to the front of the register with a
+    // permutation looked up by the comparison mask, and stores all four: the ones that failed are
+    // overwritten by the next store. out never passes values, so the store stays within out.
+    template<typename T>
+    __attribute__((target("avx2,fma"))) static std::size_t avx2_filter_less(std::span<T const> values, T threshold, T* out)
+    {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        for (; i + 4 <= values.size(); i += 4) {
+            __m256i value;
+            int mask;
+            if constexpr (std::is_integral_v<T>) {
+                value = load(values.data() + i);
+                mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(threshold), value)));
+            } else {
+                auto double_value = _mm256_loadu_pd(values.data() + i);
+                value = _mm256_castpd_si256(double_value);
+                mask = _mm256_movemask_pd(_mm256_cmp_pd(double_value, _mm256_set1_pd(threshold), _CMP_LT_OQ));
+            }
+            auto permutation = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s_compress_permutations[mask].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + count), _mm256_permutevar8x32_epi32(value, permutation));
+            count += __builtin_popcount(mask);
+        }
+        return count + scalar_filter_less(values.subspan(i), threshold, out + count);
+    }
+
+#else
+    // The scalar versions under the AVX2 names, so that the dispatch above needs no guard of its own.
+    static std::optional<long> avx2_sum(std::span<long const> values) { return scalar_sum(values); }
+    static double avx2_sum(std::span<double const> values) { return scalar_sum(values); }
+    static double avx2_dot(std::span<double const> lhs, std::span<double const> rhs) { return scalar_dot(lhs, rhs); }
+
+    template<typename T, typename Rhs>
+    static bool avx2_add(std::span<T const> lhs, Rhs rhs, std::span<T> out) { return scalar_add(lhs, rhs, out); }
+
+    template<bool is_max, typename T>
+    static T avx2_min_max(std::span<T const> values) { return scalar_min_max<is_max>(values); }
+
+    template<typename T>
+    static std::size_t avx2_filter_less(std::span<T const> values, T threshold, T* out) { return scalar_filter_less(values, threshold, out); }
+#endif
+
+private:
+#if defined(__x86_64__)
+    __attribute__((target("avx2,fma"))) static __m256i load(long const* values)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values));
+    }
+
+    __attribute__((target("avx2,fma"))) static double horizontal_sum(__m256d values)
+    {
+        auto pairs = _mm_add_pd(_mm256_castpd256_pd128(values), _mm256_extractf128_pd(values, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pairs, _mm_unpackhi_pd(pairs, pairs)));
+    }
+
+    // For each 4-bit mask of passing 64-bit lanes, the 32-bit lane indices that move them to the front.
+    static constexpr auto s_compress_permutations = [] {
+        std::array<std::array<std::int32_t, 8>, 16> permutations {};
+        for (std::size_t mask = 0; mask < 16; ++mask) {
+            std::size_t next = 0;
+            for (std::int32_t lane = 0; lane < 4; ++lane) {
+                if (mask & (1 << lane)) {
+                    permutations[mask][next++] = 2 * lane;
+                    permutations[mask][next++] = 2 * lane + 1;
+                }
+            }
+        }
+        return permutations;
+    }();
+#endif
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <utility>
+
+class MalType;
+
+// An immutable hash map. Up to array_map_limit entries it is a flat array of key/value pairs searched
+// linearly; above that it is a hash array mapped trie (HAMT): each node has a 32-bit bitmap of the
+// 5-bit hash chunks present at its level, followed by only those entries. assoc and dissoc copy one
+// root-to-leaf path, and each version shares every other node with the version it was made from.
+// Nodes are never freed, like every other value in this interpreter, so sharing them needs no bookkeeping.
+//
+// A transient (see transient()) changes the nodes it allocated itself in place, and gives them spare room
+// for entries; any other node is copied the first time it changes. The persistent operations are the same
+// code run without an Edit, so that every node they touch is copied.
+//
+// The memory resource given to the constructor only serves building that version, for example from the
+// reader's arena, which is not thread-safe; the versions made from it allocate from the default resource.
+//
+// KeyTraits provides static hash(MalType*) and equal(MalType*, MalType*), so that this header does not
+// need the complete MalType hierarchy.
+template<typename KeyTraits>
+class PersistentHashMap {
+public:
+    static constexpr unsigned bits = 5;
+    static constexpr std::size_t mask = (1 << bits) - 1;
+    static constexpr std::size_t array_map_limit = 8;
+
+    // Identifies the nodes owned by one transient.
+    struct Edit { };
+
+    struct Node;
+
+    // A key/value pair, or a subnode when key is nullptr.
+    struct Entry {
+        MalType* key;
+        union {
+            MalType* value;
+            Node* node;
+        };
+    };
+
+    struct alignas(Entry) Node {
+        // Linear nodes are the array map at the root, and collision nodes (keys with equal hashes) below it.
+        bool linear;
+        std::uint32_t bitmap;
+        std::uint32_t length;
+        std::uint32_t capacity;
+        Edit const* edit;
+
+        Entry* entries() { return reinterpret_cast<Entry*>(this + 1); }
+        Entry const* entries() const { return reinterpret_cast<Entry const*>(this + 1); }
+    };
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<MalType*, MalType*>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        explicit Iterator(Node const* root)
+            : m_entry(root->entries())
+            , m_end(root->entries() + root->length)
+        {
+            settle();
+        }
+
+        value_type operator*() const { return { m_entry->key, m_entry->value }; }
+
+        Iterator& operator++()
+        {
+            ++m_entry;
+            settle();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(Iterator const& other) const { return m_entry == other.m_entry; }
+
+    private:
+        // Moves to the next key/value pair at or after m_entry, descending into subnodes depth first.
+        void settle()
+        {
+            while (true) {
+                if (m_entry == m_end) {
+                    if (m_depth == 0) {
+                        m_entry = nullptr;
+                        return;
+                    }
+                    --m_depth;
+                    m_entry = m_stack[m_depth].first;
+                    m_end = m_stack[m_depth].second;
+                    continue;
+                }
+                if (m_entry->key)
+                    return;
+                auto const* child = m_entry->node;
+                m_stack[m_depth++] = { m_entry + 1, m_end };
+                m_entry = child->entries();
+                m_end = m_entry + child->length;
+            }
+        }
+
+        // A 64-bit hash is used up after 13 levels, collision nodes only add one more.
+        static constexpr std::size_t max_depth = 64 / bits + 2;
+
+        Entry const* m_entry { nullptr };
+        Entry const* m_end { nullptr };
+        std::pair<Entry const*, Entry const*> m_stack[max_depth];
+        std::size_t m_depth { 0 };
+    };
+
+    PersistentHashMap() = default;
+
+    explicit PersistentHashMap(std::pmr::memory_resource* resource)
+        : m_resource(resource)
+    {
+    }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    MalType* find(MalType* key) const
+    {
+        if (m_root->linear)
+            return find_linear(m_root, key);
+        return find_in(m_root, 0, KeyTraits::hash(key), key);
+    }
+
+    PersistentHashMap assoc(MalType* key, MalType* value) const
+    {
+        auto result = persistent_copy();
+        result.assoc_in_place(key, value);
+        return result;
+    }
+
+    PersistentHashMap dissoc(MalType* key) const
+    {
+        auto result = persistent_copy();
+        result.dissoc_in_place(key);
+        return result;
+    }
+
+    // A map whose *_in_place functions may change the nodes they allocate.
+    // It must stay with a single owner until persistent() is called.
+    PersistentHashMap transient() const
+    {
+        auto result = *this;
+        result.m_edit = new (std::pmr::get_default_resource()->allocate(sizeof(Edit), alignof(Edit))) Edit;
+        result.m_resource = std::pmr::get_default_resource();
+        return result;
+    }
+
+    // O(1): the nodes owned by the transient simply stop being changed.
+    PersistentHashMap persistent() const { return persistent_copy(); }
+
+    bool is_transient() const { return m_edit; }
+
+    std::pmr::memory_resource* resource() const { return m_resource; }
+
+    void assoc_in_place(MalType* key, MalType* value)
+    {
+        bool added = false;
+        if (!m_root->linear) {
+            m_root = assoc_in(m_root, 0, KeyTraits::hash(key), key, value, added);
+        } else if (auto* root = assoc_linear(m_root, key, value, added); root->length <= array_map_limit) {
+            m_root = root;
+        } else {
+            // The array map is full, rehash its entries into a trie.
+            m_root = make_node(false, 0, 0);
+            for (auto const& entry : std::span(root->entries(), root->length)) {
+                bool ignored;
+                m_root = assoc_in(m_root, 0, KeyTraits::hash(entry.key), entry.key, entry.value, ignored);
+            }
+        }
+        m_size += added;
+    }
+
+    void dissoc_in_place(MalType* key)
+    {
+        bool removed = false;
+        if (m_root->linear)
+            m_root = dissoc_linear(m_root, key, removed);
+        else
+            m_root = dissoc_in(m_root, 0, KeyTraits::hash(key), key, removed);
+        if (!m_root)
+            m_root = &s_empty_root;
+        m_size -= removed;
+    }
+
+    // Equal keys map to equal values, whatever order the entries were added in.
+    template<typename ValueEqual>
+    bool equals(PersistentHashMap const& other, ValueEqual value_equal) const
+    {
+        if (m_size != other.m_size)
+            return false;
+        for (auto [key, value] : *this) {
+            auto* other_value = other.find(key);
+            if (!other_value || !value_equal(value, other_value))
+                return false;
+        }
+        return true;
+    }
+
+    Iterator begin() const { return Iterator { m_root }; }
+    Iterator end() const { return {}; }
+
+private:
+    static std::uint32_t bit_for(std::size_t hash, unsigned shift) { return std::uint32_t { 1 } << ((hash >> shift) & mask); }
+    static std::uint32_t index_for(Node const* node, std::uint32_t bit) { return std::popcount(node->bitmap & (bit - 1)); }
+
+    PersistentHashMap persistent_copy() const
+    {
+        auto result = *this;
+        result.m_edit = nullptr;
+        result.m_resource = std::pmr::get_default_resource();
+        return result;
+    }
+
+    // Nodes of a transient get room to grow, up to the 32 entries a bitmap node can have.
+    std::uint32_t capacity_for(bool linear, std::uint32_t length) const
+    {
+        if (!m_edit)
+            return length;
+        return linear ? length * 2 : std::min<std::uint32_t>(length * 2, 1 << bits);
+    }
+
+    Node* make_node(bool linear, std::uint32_t bitmap, std::uint32_t length) const
+    {
+        auto capacity = std::max(length, capacity_for(linear, length));
+        auto* memory = m_resource->allocate(sizeof(Node) + capacity * sizeof(Entry), alignof(Node));
+        return new (memory) Node { linear, bitmap, length, capacity, m_edit };
+    }
+
+    bool is_editable(Node const* node) const { return m_edit && node->edit == m_edit; }
+
+    Node* ensure_editable(Node* node) const
+    {
+        if (is_editable(node))
+            return node;
+        auto* result = make_node(node->linear, node->bitmap, node->length);
+        std::copy_n(node->entries(), node->length, result->entries());
+        return result;
+    }
+
+    Node* insert_entry(Node* node, std::uint32_t bitmap, std::uint32_t index, Entry entry) const
+    {
+        auto* result = node;
+        if (!is_editable(node) || node->length == node->capacity) {
+            result = make_node(node->linear, bitmap, node->length + 1);
+            std::copy_n(node->entries(), index, result->entries());
+        }
+        std::copy_backward(node->entries() + index, node->entries() + node->length, result->entries() + node->length + 1);
+        result->entries()[index] = entry;
+        result->bitmap = bitmap;
+        result->length = node->length + 1;
+        return result;
+    }
+
+    Node* remove_entry(Node* node, std::uint32_t bitmap, std::uint32_t index) const
+    {
+        auto* result = node;
+        if (!is_editable(node)) {
+            result = make_node(node->linear, bitmap, node->length - 1);
+            std::copy_n(node->entries(), index, result->entries());
+        }
+        std::copy(node->entries() + index + 1, node->entries() + node->length, result->entries() + index);
+        result->bitmap = bitmap;
+        result->length = node->length - 1;
+        return result;
+    }
+
+    static MalType* find_linear(Node const* node, MalType* key)
+    {
+        for (std::uint32_t i = 0; i < node->length; ++i) {
+            if (KeyTraits::equal(node->entries()[i].key, key))
+                return node->entries()[i].value;
+        }
+        return nullptr;
+    }
+
+    static MalType* find_in(Node const* node, unsigned shift, std::size_t hash, MalType* key)
+    {
+        while (!node->linear) {
+            auto bit = bit_for(hash, shift);
+            if (!(node->bitmap & bit))
+                return nullptr;
+            auto const& entry = node->entries()[index_for(node, bit)];
+            if (entry.key)
+                return KeyTraits::equal(entry.key, key) ? entry.value : nullptr;
+            node = entry.node;
+            shift += bits;
+        }
+        return find_linear(node, key);
+    }
+
+    Node* assoc_linear(Node* node, MalType* key, MalType* value, bool& added) const
+    {
+        for (std::uint32_t i = 0; i < node->length; ++i) {
+            if (KeyTraits::equal(node->entries()[i].key, key)) {
+                if (node->entries()[i].value == value)
+                    return node;
+                auto* result = ensure_editable(node);
+                result->entries()[i].value = value;
+                return result;
+            }
+        }
+        added = true;
+        return insert_entry(node, node->bitmap, node->length, Entry { key, { value } });
+    }
+
+    Node* assoc_in(Node* node, unsigned shift, std::size_t hash, MalType* key, MalType* value, bool& added) const
+    {
+        if (node->linear) {
+            auto collision_hash = KeyTraits::hash(node->entries()[0].key);
+            if (collision_hash == hash)
+                return assoc_linear(node, key, value, added);
+            // Not the same hash after all: put the collision node one level down, next to the new key.
+            auto* split = make_node(false, bit_for(collision_hash, shift), 1);
+            split->entries()[0].key = nullptr;
+            split->entries()[0].node = node;
+            return assoc_in(split, shift, hash, key, value, added);
+        }
+
+        auto bit = bit_for(hash, shift);
+        auto index = index_for(node, bit);
+        if (!(node->bitmap & bit)) {
+            added = true;
+            return insert_entry(node, node->bitmap | bit, index, Entry { key, { value } });
+        }
+
+        auto const& entry = node->entries()[index];
+        Entry replacement;
+        if (!entry.key) {
+            replacement.key = nullptr;
+            replacement.node = assoc_in(entry.node, shift + bits, hash, key, value, added);
+            if (replacement.node == entry.node)
+                return node;
+        } else if (KeyTraits::equal(entry.key, key)) {
+            if (entry.value == value)
+                return node;
+            replacement = Entry { key, { value } };
+        } else {
+            added = true;
+            replacement.key = nullptr;
+            replacement.node = make_pair_node(shift + bits, KeyTraits::hash(entry.key), entry.key, entry.value, hash, key, value);
+        }
+        auto* result = ensure_editable(node);
+        result->entries()[index] = replacement;
+        return result;
+    }
+
+    Node* make_pair_node(unsigned shift, std::size_t hash1, MalType* key1, MalType* value1, std::size_t hash2, MalType* key2, MalType* value2) const
+    {
+        if (hash1 == hash2) {
+            auto* node = make_node(true, 0, 2);
+            node->entries()[0] = Entry { key1, { value1 } };
+            node->entries()[1] = Entry { key2, { value2 } };
+            return node;
+        }
+        auto bit1 = bit_for(hash1, shift);
+        auto bit2 = bit_for(hash2, shift);
+        if (bit1 == bit2) {
+            auto* node = make_node(false, bit1, 1);
+            node->entries()[0].key = nullptr;
+            node->entries()[0].node = make_pair_node(shift + bits, hash1, key1, value1, hash2, key2, value2);
+            return node;
+        }
+        auto* node = make_node(false, bit1 | bit2, 2);
+        node->entries()[bit1 < bit2 ? 0 : 1] = Entry { key1, { value1 } };
+        node->entries()[bit1 < bit2 ? 1 : 0] = Entry { key2, { value2 } };
+        return node;
+    }
+
+    // Returns nullptr once the node has no entries left.
+    Node* dissoc_linear(Node* node, MalType* key, bool& removed) const
+    {
+        for (std::uint32_t i = 0; i < node->length; ++i) {
+            if (KeyTraits::equal(node->entries()[i].key, key)) {
+                removed = true;
+                if (node->length == 1)
+                    return nullptr;
+                return remove_entry(node, node->bitmap, i);
+            }
+        }
+        return node;
+    }
+
+    Node* dissoc_in(Node* node, unsigned shift, std::size_t hash, MalType* key, bool& removed) const
+    {
+        if (node->linear)
+            return dissoc_linear(node, key, removed);
+
+        auto bit = bit_for(hash, shift);
+        if (!(node->bitmap & bit))
+            return node;
+        auto index = index_for(node, bit);
+        auto const& entry = node->entries()[index];
+        if (entry.key) {
+            if (!KeyTraits::equal(entry.key, key))
+                return node;
+            removed = true;
+        } else {
+            auto* child = dissoc_in(entry.node, shift + bits, hash, key, removed);
+            if (child == entry.node)
+                return node;
+            if (child) {
+                auto* result = ensure_editable(node);
+                result->entries()[index].node = child;
+                return result;
+            }
+        }
+        if (node->length == 1)
+            return nullptr;
+        return remove_entry(node, node->bitmap & ~bit, index);
+    }
+
+    // Shared by all empty maps. It is owned by no transient, so it is never written to.
+    static inline Node s_empty_root { true, 0, 0, 0, nullptr };
+
+    std::pmr::memory_resource* m_resource { std::pmr::get_default_resource() };
+    Edit const* m_edit { nullptr };
+    Node* m_root { &s_empty_root };
+    std::size_t m_size { 0 };
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+
+class MalType;
+
+// An immutable map ordered by key, stored as an AVL tree. assoc and dissoc copy the O(log n) nodes on the
+// path to the key (plus the few a rotation touches), and each version shares every other node with the
+// version it was made from. Nodes are never freed, like every other value in this interpreter.
+//
+// Iterators walk in either direction from any key, so a range scan costs O(log n) to find its start
+// and O(1) amortized per entry after that.
+//
+// The memory resource given to the constructor only serves building that version, for example from the
+// reader's arena, which is not thread-safe; the versions made from it allocate from the default resource.
+//
+// KeyTraits provides static compare(MalType*, MalType*), returning <0, 0 or >0 like strcmp, so that
+// this header does not need the complete MalType hierarchy.
+template<typename KeyTraits>
+class PersistentSortedMap {
+public:
+    struct Node {
+        MalType* key;
+        MalType* value;
+        Node const* left;
+        Node const* right;
+        std::uint8_t height;
+    };
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<MalType*, MalType*>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        value_type operator*() const { return { top()->key, top()->value }; }
+
+        Iterator& operator++()
+        {
+            auto const* node = m_stack[--m_depth];
+            push_spine(m_descending ? node->left : node->right);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(Iterator const& other) const
+        {
+            return (m_depth ? top() : nullptr) == (other.m_depth ? other.top() : nullptr);
+        }
+
+    private:
+        friend class PersistentSortedMap;
+
+        // An AVL tree of height h has at least fib(h + 2) - 1 nodes, so 64 levels is more than enough.
+        static constexpr std::size_t max_depth = 64;
+
+        explicit Iterator(bool descending)
+            : m_descending(descending)
+        {
+        }
+
+        Node const* top() const { return m_stack[m_depth - 1]; }
+
+        void push(Node const* node)
+        {
+            assert(m_depth < max_depth);
+            m_stack[m_depth++] = node;
+        }
+
+        // Pushes node and its chain of smaller (or, descending, larger) children; the last one pushed is next.
+        void push_spine(Node const* node)
+        {
+            for (; node; node = m_descending ? node->right : node->left)
+                push(node);
+        }
+
+        Node const* m_stack[max_depth];
+        std::size_t m_depth { 0 };
+        bool m_descending { false };
+    };
+
+    PersistentSortedMap() = default;
+
+    explicit PersistentSortedMap(std::pmr::memory_resource* resource)
+        : m_resource(resource)
+    {
+    }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    MalType* find(MalType* key) const
+    {
+        for (auto const* node = m_root; node;) {
+            auto order = KeyTraits::compare(key, node->key);
+            if (order == 0)
+                return node->value;
+            node = order < 0 ? node->left : node->right;
+        }
+        return nullptr;
+    }
+
+    PersistentSortedMap assoc(MalType* key, MalType* value) const
+    {
+        auto result = derived();
+        bool added = false;
+        result.m_root = result.assoc_in(m_root, key, value, added);
+        result.m_size += added;
+        return result;
+    }
+
+    PersistentSortedMap dissoc(MalType* key) const
+    {
+        auto result = derived();
+        bool removed = false;
+        result.m_root = result.dissoc_in(m_root, key, removed);
+        result.m_size -= removed;
+        return result;
+    }
+
+    Iterator begin() const
+    {
+        Iterator iterator { false };
+        iterator.push_spine(m_root);
+        return iterator;
+    }
+
+    Iterator end() const { return {}; }
+
+    // From the largest key down to the smallest.
+    Iterator descending() const
+    {
+        Iterator iterator { true };
+        iterator.push_spine(m_root);
+        return iterator;
+    }
+
+    // Ascending from the first key after key, or at it when inclusive.
+    Iterator ascending_from(MalType* key, bool inclusive) const
+    {
+        Iterator iterator { false };
+        for (auto const* node = m_root; node;) {
+            auto order = KeyTraits::compare(node->key, key);
+            if (order > 0 || (inclusive && order == 0)) {
+                iterator.push(node);
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return iterator;
+    }
+
+    // Descending from the last key before key, or at it when inclusive.
+    Iterator descending_from(MalType* key, bool inclusive) const
+    {
+        Iterator iterator { true };
+        for (auto const* node = m_root; node;) {
+            auto order = KeyTraits::compare(node->key, key);
+            if (order < 0 || (inclusive && order == 0)) {
+                iterator.push(node);
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return iterator;
+    }
+
+private:
+    static int height(Node const* node) { return node ? node->height : 0; }
+
+    PersistentSortedMap derived() const
+    {
+        auto result = *this;
+        result.m_resource = std::pmr::get_default_resource();
+        return result;
+    }
+
+    Node const* make_node(MalType* key, MalType* value, Node const* left, Node const* right) const
+    {
+        auto* memory = m_resource->allocate(sizeof(Node), alignof(Node));
+        auto node_height = static_cast<std::uint8_t>(1 + std::max(height(left), height(right)));
+        return new (memory) Node { key, value, left, right, node_height };
+    }
+
+    // Like make_node, but rotates first if the heights of left and right differ by two.
+    Node const* balance(MalType* key, MalType* value, Node const* left, Node const* right) const
+    {
+        if (height(left) > height(right) + 1) {
+            if (height(left->left) >= height(left->right))
+                return make_node(left->key, left->value, left->left, make_node(key, value, left->right, right));
+            auto const* middle = left->right;
+            return make_node(middle->key, middle->value,
+                make_node(left->key, left->value, left->left, middle->left),
+                make_node(key, value, middle->right, right));
+        }
+        if (height(right) > height(left) + 1) {
+            if (height(right->right) >= height(right->left))
+                return make_node(right->key, right->value, make_node(key, value, left, right->left), right->right);
+            auto const* middle = right->left;
+            return make_node(middle->key, middle->value,
+                make_node(key, value, left, middle->left),
+                make_node(right->key, right->value, middle->right, right->right));
+        }
+        return make_node(key, value, left, right);
+    }
+
+    Node const* assoc_in(Node const* node, MalType* key, MalType* value, bool& added) const
+    {
+        if (!node) {
+            added = true;
+            return make_node(key, value, nullptr, nullptr);
+        }
+        auto order = KeyTraits::compare(key, node->key);
+        if (order < 0)
+            return balance(node->key, node->value, assoc_in(node->left, key, value, added), node->right);
+        if (order > 0)
+            return balance(node->key, node->value, node->left, assoc_in(node->right, key, value, added));
+        if (node->value == value)
+            return node;
+        return make_node(node->key, value, node->left, node->right);
+    }
+
+    Node const* dissoc_in(Node const* node, MalType* key, bool& removed) const
+    {
+        if (!node)
+            return nullptr;
+        auto order = KeyTraits::compare(key, node->key);
+        if (order < 0) {
+            auto const* left = dissoc_in(node->left, key, removed);
+            return left == node->left ? node : balance(node->key, node->value, left, node->right);
+        }
+        if (order > 0) {
+            auto const* right = dissoc_in(node->right, key, removed);
+            return right == node->right ? node : balance(node->key, node->value, node->left, right);
+        }
+        removed = true;
+        if (!node->left)
+            return node->right;
+        if (!node->right)
+            return node->left;
+        // Replace the node with the smallest entry of its right subtree.
+        auto const* successor = node->right;
+        while (successor->left)
+            successor = successor->left;
+        return balance(successor->key, successor->value, node->left, dissoc_smallest(node->right));
+    }
+
+    Node const* dissoc_smallest(Node const* node) const
+    {
+        if (!node->left)
+            return node->right;
+        return balance(node->key, node->value, dissoc_smallest(node->left), node->right);
+    }
+
+    std::pmr::memory_resource* m_resource { std::pmr::get_default_resource() };
+    Node const* m_root { nullptr };
+    std::size_t m_size { 0 };
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+class MalType;
+
+// An immutable vector stored as a 32-way bit-partitioned trie plus a tail (the last, partially filled leaf),
+// as in Clojure. conj, assoc and nth touch at most one path of the trie, and every version shares all
+// the nodes it did not change with the version it was made from.
+// Nodes are never freed, like every other value in this interpreter, so sharing them needs no bookkeeping.
+//
+// A transient (see transient()) changes the nodes it allocated itself in place and copies any other node
+// the first time it changes it, so building a vector element by element does not copy a path per element.
+// Every node starts with a hidden header slot that records the Edit it was allocated by, if any.
+//
+// The memory resource given to the constructor only serves building that version, for example from the
+// reader's arena, which is not thread-safe; the versions made from it allocate from the default resource.
+class PersistentVector {
+public:
+    static constexpr unsigned bits = 5;
+    static constexpr std::size_t width = 1 << bits;
+    static constexpr std::size_t mask = width - 1;
+
+    // Identifies the nodes owned by one transient.
+    struct Edit { };
+
+    // Internal nodes point to nodes, leaves (and the tail) hold the elements.
+    union Slot {
+        Slot* node;
+        MalType* value;
+        Edit const* edit;
+    };
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MalType*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = MalType* const*;
+        using reference = MalType* const&;
+
+        Iterator() = default;
+        Iterator(PersistentVector const* vector, std::size_t index)
+            : m_vector(vector)
+            , m_index(index)
+            , m_leaf(index < vector->size() ? vector->leaf_for(index) : nullptr)
+        {
+        }
+
+        reference operator*() const { return m_leaf[m_index & mask].value; }
+
+        Iterator& operator++()
+        {
+            ++m_index;
+            if ((m_index & mask) == 0 && m_index < m_vector->size())
+                m_leaf = m_vector->leaf_for(m_index);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(Iterator const& other) const { return m_index == other.m_index; }
+
+    private:
+        PersistentVector const* m_vector { nullptr };
+        std::size_t m_index { 0 };
+        Slot const* m_leaf { nullptr };
+    };
+
+    PersistentVector() = default;
+
+    // Builds the trie bottom-up with full leaves; only the tail is sized to what is left over.
+    PersistentVector(std::span<MalType* const> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_resource(resource)
+        , m_root(nullptr)
+        , m_size(elements.size())
+    {
+        auto offset = tail_offset();
+        m_tail = allocate(m_size - offset);
+        for (std::size_t i = offset; i < m_size; ++i)
+            m_tail[i - offset].value = elements[i];
+
+        // Each level is stored in place over the previous one in a scratch array of node pointers.
+        std::vector<Slot*> level;
+        level.reserve(offset / width);
+        for (std::size_t i = 0; i < offset; i += width) {
+            auto* leaf = allocate(width);
+            for (std::size_t j = 0; j < width; ++j)
+                leaf[j].value = elements[i + j];
+            level.push_back(leaf);
+        }
+        while (level.size() > width) {
+            std::size_t parents = 0;
+            for (std::size_t i = 0; i < level.size(); i += width)
+                level[parents++] = make_node(std::span(level).subspan(i, std::min(width, level.size() - i)));
+            level.resize(parents);
+            m_shift += bits;
+        }
+        m_root = level.empty() ? s_empty_root + 1 : make_node(level);
+    }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    MalType* nth(std::size_t index) const
+    {
+        assert(index < m_size);
+        return leaf_for(index)[index & mask].value;
+    }
+
+    PersistentVector conj(MalType* value) const
+    {
+        auto result = persistent_copy();
+        result.conj_in_place(value);
+        return result;
+    }
+
+    PersistentVector assoc(std::size_t index, MalType* value) const
+    {
+        auto result = persistent_copy();
+        result.assoc_in_place(index, value);
+        return result;
+    }
+
+    // A vector whose *_in_place functions may change the nodes they allocate.
+    // It must stay with a single owner until persistent() is called.
+    PersistentVector transient() const
+    {
+        auto result = *this;
+        result.m_edit = new (std::pmr::get_default_resource()->allocate(sizeof(Edit), alignof(Edit))) Edit;
+        result.m_resource = std::pmr::get_default_resource();
+        return result;
+    }
+
+    // O(1): the nodes owned by the transient simply stop being changed.
+    PersistentVector persistent() const { return persistent_copy(); }
+
+    bool is_transient() const { return m_edit; }
+
+    void conj_in_place(MalType* value)
+    {
+        auto tail_size = m_size - tail_offset();
+        if (tail_size < width) {
+            m_tail = editable_tail(tail_size + 1);
+            m_tail[tail_size].value = value;
+            ++m_size;
+            return;
+        }
+
+        // The tail is full: it becomes a leaf of the trie, and a new tail is started.
+        auto* tail_leaf = m_tail;
+        if ((m_size >> bits) > (std::size_t { 1 } << m_shift)) {
+            // No room left under the root, so grow the trie by one level.
+            auto* root = allocate(width);
+            root[0].node = m_root;
+            root[1].node = new_path(m_shift, tail_leaf);
+            m_root = root;
+            m_shift += bits;
+        } else {
+            m_root = push_tail(m_shift, m_root, tail_leaf);
+        }
+        m_tail = allocate(m_edit ? width : 1);
+        m_tail[0].value = value;
+        ++m_size;
+    }
+
+    void assoc_in_place(std::size_t index, MalType* value)
+    {
+        assert(index <= m_size);
+        if (index == m_size)
+            return conj_in_place(value);
+
+        auto offset = tail_offset();
+        if (index >= offset) {
+            m_tail = editable_tail(m_size - offset);
+            m_tail[index & mask].value = value;
+        } else {
+            m_root = assoc_in(m_shift, m_root, index, value);
+        }
+    }
+
+    Iterator begin() const { return { this, 0 }; }
+    Iterator end() const { return { this, m_size }; }
+
+private:
+    std::size_t tail_offset() const { return m_size < width ? 0 : ((m_size - 1) >> bits) << bits; }
+
+    Slot const* leaf_for(std::size_t index) const
+    {
+        if (index >= tail_offset())
+            return m_tail;
+        Slot const* node = m_root;
+        for (auto level = m_shift; level > 0; level -= bits)
+            node = node[(index >> level) & mask].node;
+        return node;
+    }
+
+    PersistentVector persistent_copy() const
+    {
+        auto result = *this;
+        result.m_edit = nullptr;
+        result.m_resource = std::pmr::get_default_resource();
+        return result;
+    }
+
+    // Allocates count slots after a header slot holding m_edit.
+    Slot* allocate(std::size_t count) const
+    {
+        if (count == 0)
+            return nullptr;
+        auto* slots = static_cast<Slot*>(m_resource->allocate((count + 1) * sizeof(Slot), alignof(Slot)));
+        std::fill_n(slots, count + 1, Slot { nullptr });
+        slots[0].edit = m_edit;
+        return slots + 1;
+    }
+
+    Slot* copy(Slot const* slots, std::size_t count, std::size_t new_count) const
+    {
+        auto* result = allocate(new_count);
+        std::copy_n(slots, count, result);
+        return result;
+    }
+
+    bool is_editable(Slot const* node) const { return m_edit && node && node[-1].edit == m_edit; }
+
+    Slot* ensure_editable(Slot* node) const
+    {
+        return is_editable(node) ? node : copy(node, width, width);
+    }
+
+    // A transient's tail always has room for a full leaf, a persistent vector's tail is sized exactly.
+    Slot* editable_tail(std::size_t new_size) const
+    {
+        if (is_editable(m_tail))
+            return m_tail;
+        return copy(m_tail, m_size - tail_offset(), m_edit ? width : new_size);
+    }
+
+    Slot* make_node(std::span<Slot* const> children) const
+    {
+        auto* node = allocate(width);
+        for (std::size_t i = 0; i < children.size(); ++i)
+            node[i].node = children[i];
+        return node;
+    }
+
+    Slot* new_path(unsigned level, Slot* leaf) const
+    {
+        if (level == 0)
+            return leaf;
+        auto* node = allocate(width);
+        node[0].node = new_path(level - bits, leaf);
+        return node;
+    }
+
+    Slot* push_tail(unsigned level, Slot* parent, Slot* tail_leaf) const
+    {
+        auto child_index = ((m_size - 1) >> level) & mask;
+        auto* node = ensure_editable(parent);
+        if (level == bits)
+            node[child_index].node = tail_leaf;
+        else if (auto* child = parent[child_index].node)
+            node[child_index].node = push_tail(level - bits, child, tail_leaf);
+        else
+            node[child_index].node = new_path(level - bits, tail_leaf);
+        return node;
+    }
+
+    Slot* assoc_in(unsigned level, Slot* node, std::size_t index, MalType* value) const
+    {
+        auto* result = ensure_editable(node);
+        if (level == 0)
+            result[index & mask].value = value;
+        else
+            result[(index >> level) & mask].node = assoc_in(level - bits, node[(index >> level) & mask].node, index, value);
+        return result;
+    }
+
+    // Shared by all vectors with an empty trie. It is owned by no transient, so it is never written to.
+    static inline Slot s_empty_root[width + 1] {};
+
+    std::pmr::memory_resource* m_resource { std::pmr::get_default_resource() };
+    Edit const* m_edit { nullptr };
+    Slot* m_root { s_empty_root + 1 };
+    Slot* m_tail { nullptr };
+    std::size_t m_size { 0 };
+    unsigned m_shift { bits };
+};
@@ -1,10 +1,19 @@
 #include "printer.h"
 #include "types.h"
 
+#include <mutex>
+
 std::string pr_str(MalType* mal_type, bool print_readably)
 {
     if (mal_type)
         return mal_type->inspect(print_readably);
 
     return {};
-}
\ No newline at end of file
+}
+
+void print_line(std::string_view line, std::ostream& stream)
+{
+    static std::mutex s_output_mutex;
+    std::lock_guard lock { s_output_mutex };
+    stream << line << '\n';
+}
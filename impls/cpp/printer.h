@@ -1,6 +1,12 @@
 #pragma once
 
+#include <iostream>
 #include <string>
+#include <string_view>
 
 class MalType;
-std::string pr_str(MalType* mal_type, bool print_readably = true);
\ No newline at end of file
+std::string pr_str(MalType* mal_type, bool print_readably = true);
+
+// Writes line and a newline to stream in one locked write, so that lines printed by different threads
+// do not interleave.
+void print_line(std::string_view line, std::ostream& stream = std::cout);
@@ -1,20 +1,367 @@
 #include "reader.h"
 #include "types.h"
 
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_set>
+
+// A guess of the arena bytes one token turns into: the node itself plus its slot in the parent's element array.
+constexpr std::size_t g_arena_bytes_per_token = 48;
+
+template<typename T, typename... Args>
+static T* make(Reader& reader, Args&&... args)
+{
+    if (auto* arena = reader.arena())
+        return new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    return new T(std::forward<Args>(args)...);
+}
+
+// What a node would be made of, to look an equal node up before making it: an atom to compare with,
+// or the elements of a collection.
+struct InternKey {
+    MalType::Type type;
+    MalType const* atom;
+    std::span<MalType* const> elements;
+};
+
+// The nodes read in ReadMode::HashConsed. The elements of an interned collection are interned too,
+// so two collections are equal exactly when they hold the same element pointers: hashing and comparing
+// one costs a pass over its own elements, never over the whole subtree.
+// Nothing is ever freed, so the table simply keeps every node alive rather than being a weak table.
+class InternTable {
+public:
+    MalType* find(InternKey const& key) const
+    {
+        auto it = m_nodes.find(key);
+        return it != m_nodes.end() ? *it : nullptr;
+    }
+
+    void insert(MalType* node) { m_nodes.insert(node); }
+
+private:
+    static std::size_t with_type(std::size_t hash, MalType::Type type)
+    {
+        return hash ^ (static_cast<std::size_t>(type) * 0x9e3779b97f4a7c15);
+    }
+
+    static std::size_t element_hash(MalType const* element) { return std::hash<MalType const*> {}(element); }
+
+    template<typename Sequence>
+    static std::size_t ordered_hash(Sequence const& sequence)
+    {
+        std::size_t result = 1;
+        for (auto* element : sequence)
+            result = result * 31 + element_hash(element);
+        return result;
+    }
+
+    static std::size_t entry_hash(MalType const* key, MalType const* value) { return element_hash(key) ^ (element_hash(value) * 31); }
+
+    struct Hash {
+        using is_transparent = void;
+
+        std::size_t operator()(MalType* node) const
+        {
+            std::size_t result = 0;
+            switch (node->type()) {
+            case MalType::Type::List:
+                result = ordered_hash(*static_cast<MalList*>(node));
+                break;
+            case MalType::Type::Vector:
+                result = ordered_hash(*static_cast<MalVector*>(node));
+                break;
+            case MalType::Type::HashMap:
+                for (auto [key, value] : *static_cast<MalHashMap*>(node))
+                    result += entry_hash(key, value);
+                break;
+            case MalType::Type::HashSet:
+                for (auto [element, ignored] : *static_cast<MalHashSet*>(node))
+                    result += element_hash(element);
+                break;
+            default:
+                result = node->hash();
+                break;
+            }
+            return with_type(result, node->type());
+        }
+
+        std::size_t operator()(InternKey const& key) const
+        {
+            if (key.atom)
+                return with_type(key.atom->hash(), key.type);
+            std::size_t result = 0;
+            switch (key.type) {
+            case MalType::Type::HashMap:
+                for (std::size_t i = 0; i + 1 < key.elements.size(); i += 2)
+                    result += entry_hash(key.elements[i], key.elements[i + 1]);
+                break;
+            case MalType::Type::HashSet:
+                for (auto* element : key.elements)
+                    result += element_hash(element);
+                break;
+            default:
+                result = ordered_hash(key.elements);
+                break;
+            }
+            return with_type(result, key.type);
+        }
+    };
+
+    struct Equal {
+        using is_transparent = void;
+
+        bool operator()(MalType* lhs, MalType* rhs) const { return lhs == rhs || (lhs->type() == rhs->type() && *lhs == *rhs); }
+        bool operator()(MalType* node, InternKey const& key) const { return (*this)(key, node); }
+
+        bool operator()(InternKey const& key, MalType* node) const
+        {
+            if (node->type() != key.type)
+                return false;
+            if (key.atom)
+                return *node == *key.atom;
+            switch (key.type) {
+            case MalType::Type::List: {
+                auto* list = static_cast<MalList*>(node);
+                return std::equal(list->begin(), list->end(), key.elements.begin(), key.elements.end());
+            }
+            case MalType::Type::Vector: {
+                auto* vector = static_cast<MalVector*>(node);
+                return vector->size() == key.elements.size() && std::equal(vector->begin(), vector->end(), key.elements.begin());
+            }
+            case MalType::Type::HashMap: {
+                auto* hash_map = static_cast<MalHashMap*>(node);
+                if (hash_map->size() * 2 != key.elements.size())
+                    return false;
+                for (std::size_t i = 0; i < key.elements.size(); i += 2) {
+                    if (hash_map->find(key.elements[i]) != key.elements[i + 1])
+                        return false;
+                }
+                return true;
+            }
+            case MalType::Type::HashSet: {
+                auto* hash_set = static_cast<MalHashSet*>(node);
+                if (hash_set->size() != key.elements.size())
+                    return false;
+                for (auto* element : key.elements) {
+                    if (hash_set->find(element) != element)
+                        return false;
+                }
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+    };
+
+    std::unordered_set<MalType*, Hash, Equal> m_nodes;
+};
+
+static InternTable g_intern_table;
+// Readers on different threads share the table.
+static std::mutex g_intern_table_mutex;
+
+// When hash-consing, returns the node equal to key if there is one, and only calls make_node otherwise.
+template<typename Make>
+static auto hash_consed(Reader& reader, InternKey const& key, Make make_node) -> decltype(make_node())
+{
+    if (!reader.hash_consing())
+        return make_node();
+    using Node = std::remove_pointer_t<decltype(make_node())>;
+    std::lock_guard lock { g_intern_table_mutex };
+    if (auto* node = g_intern_table.find(key))
+        return static_cast<Node*>(node);
+    // Like keywords, the node is shared by all isolates, so it is made outside the current one's region.
+    ThreadLocalHeap::Scope global_heap { nullptr };
+    auto* node = make_node();
+    g_intern_table.insert(node);
+    return node;
+}
+
+template<typename T, typename... Args>
+static T* make_atom(Reader& reader, Args... args)
+{
+    if (!reader.hash_consing())
+        return make<T>(reader, args...);
+    T probe { args... };
+    return hash_consed(reader, { probe.type(), &probe, {} }, [&] { return make<T>(reader, args...); });
+}
+
 std::vector<std::string_view> tokenize(std::string& input)
 {
     std::vector<std::string_view> tokens;
     Tokenizer tokenizer { input };
     for (auto token = tokenizer.next(); !token.empty(); token = tokenizer.next())
         tokens.push_back(token);
+    if (tokenizer.incomplete())
+        std::cerr << "EOF";
 
     return tokens;
 }
 
-MalType* read_str(std::string& input)
+static bool is_single_char_token(std::string_view token)
+{
+    return (token.length() == 1 && std::string_view("[]{}()'`^@").find(token[0]) != std::string_view::npos) || token == "#{";
+}
+
+void IncrementalReader::feed(std::string_view chunk)
+{
+    // A held back token can only change once a character that ends it arrives, don't rescan it before that.
+    auto can_resume = m_resume_chars.empty() || chunk.find_first_of(m_resume_chars) != std::string_view::npos;
+    m_buffer.append(chunk);
+    if (m_in_string) {
+        if (!string_closed())
+            return;
+        m_in_string = false;
+    } else if (!can_resume) {
+        return;
+    }
+    scan(false);
+    compact();
+}
+
+void IncrementalReader::finish()
+{
+    scan(true);
+    if (!m_tokens.empty() || m_tokenizer.incomplete())
+        std::cerr << "EOF\n";
+    reset();
+}
+
+MalType* IncrementalReader::next_form()
+{
+    if (m_forms.empty())
+        return nullptr;
+    auto* form = m_forms.front();
+    m_forms.pop_front();
+    return form;
+}
+
+void IncrementalReader::scan(bool at_eof)
+{
+    m_resume_chars = {};
+    for (auto token = m_tokenizer.next(); !token.empty(); token = m_tokenizer.next()) {
+        size_t start = token.data() - m_buffer.data();
+        if (!at_eof && start + token.length() == m_buffer.length() && token[0] != '"' && !is_single_char_token(token)) {
+            // A symbol, number, comment or '~' touching the end of the buffer may still continue in the next chunk.
+            m_tokenizer.set_index(start);
+            m_resume_chars = token[0] == ';' ? "\n" : " \t\n,[]{}()'`^\";@";
+            return;
+        }
+        if (token[0] == ';')
+            continue;
+
+        m_tokens.push_back({ start, token.length() });
+        if (token == "(" || token == "[" || token == "{" || token == "#{") {
+            m_closers.push_back(token == "(" ? ')' : token == "[" ? ']' : '}');
+        } else if (token == ")" || token == "]" || token == "}") {
+            // Report a closer that does not match at once, rather than hand the form to read_tokens.
+            if (m_closers.empty() || m_closers.back() != token[0]) {
+                if (m_closers.empty())
+                    std::cerr << "Unexpected '" << token << "'\n";
+                else
+                    std::cerr << "Expected '" << m_closers.back() << "', got '" << token << "'\n";
+                drop_form();
+                continue;
+            }
+            m_closers.pop_back();
+            if (m_closers.empty())
+                subform_completed();
+        } else if (m_closers.empty()) {
+            if (token == "'" || token == "`" || token == "~" || token == "~@" || token == "@")
+                m_open_prefixes.push_back(1);
+            else if (token == "^")
+                m_open_prefixes.push_back(2); // ^meta value
+            else
+                subform_completed();
+        }
+    }
+    if (m_tokenizer.incomplete()) {
+        // The tokenizer stays on the opening quote; look for the closing one in what is fed next.
+        m_in_string = true;
+        m_string_scan = m_tokenizer.index() + 1;
+        m_string_escaped = false;
+    }
+}
+
+bool IncrementalReader::string_closed()
+{
+    for (; m_string_scan < m_buffer.length(); ++m_string_scan) {
+        if (m_string_escaped)
+            m_string_escaped = false;
+        else if (m_buffer[m_string_scan] == '\\')
+            m_string_escaped = true;
+        else if (m_buffer[m_string_scan] == '"')
+            return true;
+    }
+    return false;
+}
+
+void IncrementalReader::drop_form()
+{
+    m_tokens.clear();
+    m_open_prefixes.clear();
+    m_closers.clear();
+}
+
+void IncrementalReader::subform_completed()
+{
+    while (!m_open_prefixes.empty()) {
+        if (--m_open_prefixes.back() > 0)
+            return;
+        m_open_prefixes.pop_back();
+    }
+
+    std::vector<std::string_view> tokens;
+    tokens.reserve(m_tokens.size());
+    for (auto [start, length] : m_tokens)
+        tokens.push_back(std::string_view(m_buffer).substr(start, length));
+    m_forms.push_back(read_tokens(tokens, m_mode));
+    m_tokens.clear();
+}
+
+void IncrementalReader::compact()
+{
+    // Drop the text before the form in progress. Once that form starts at offset 0 nothing is moved
+    // again until it completes, which keeps feeding a huge form linear in its size.
+    size_t form_start = m_tokens.empty() ? m_tokenizer.index() : m_tokens.front().start;
+    if (form_start == 0)
+        return;
+    m_buffer.erase(0, form_start);
+    for (auto& token : m_tokens)
+        token.start -= form_start;
+    m_tokenizer.set_index(m_tokenizer.index() - form_start);
+    if (m_in_string)
+        m_string_scan -= form_start;
+}
+
+void IncrementalReader::reset()
+{
+    m_buffer.clear();
+    m_tokenizer.set_index(0);
+    drop_form();
+    m_resume_chars = {};
+    m_in_string = false;
+}
+
+MalType* read_str(std::string& input, ReadMode mode)
 {
     auto tokens = tokenize(input);
-    Reader reader { tokens };
+    return read_tokens(tokens, mode);
+}
+
+MalType* read_tokens(std::vector<std::string_view>& tokens, ReadMode mode)
+{
+    if (mode == ReadMode::Heap || mode == ReadMode::HashConsed) {
+        Reader reader { tokens, nullptr, mode == ReadMode::HashConsed };
+        return read_form(reader);
+    }
+    // Like every other value, the form lives as long as the current region, so its arena comes from the
+    // region too and is never released on its own.
+    auto* arena = new (ThreadLocalHeap::allocate(sizeof(std::pmr::monotonic_buffer_resource)))
+        std::pmr::monotonic_buffer_resource(std::max<std::size_t>(tokens.size(), 1) * g_arena_bytes_per_token);
+    Reader reader { tokens, arena };
     return read_form(reader);
 }
 
@@ -30,6 +377,8 @@ MalType* read_form(Reader& reader)
         return read_vector(reader);
     else if (token == "{")
         return read_hash_map(reader);
+    else if (token == "#{")
+        return read_hash_set(reader);
     else if (token == "\'")
         return read_quote_value(reader, "quote");
     else if (token == "~")
@@ -49,7 +398,9 @@ MalType* read_form(Reader& reader)
     else if (token == "true")
         return read_true(reader);
     else if (is_number(token))
-        return read_integer(reader);
+        return is_float(token) ? read_float(reader) : read_integer(reader);
+    else if (token == "##Inf" || token == "##-Inf" || token == "##NaN")
+        return read_float(reader);
     else if (token[0] == '"')
         return read_string(reader);
     else if (token[0] == ':')
@@ -58,119 +409,144 @@ MalType* read_form(Reader& reader)
         return read_atom(reader);
 }
 
+template<typename Collection>
+static Collection* make_collection(Reader& reader, MalType::Type type, size_t elements_begin)
+{
+    auto elements = reader.elements_since(elements_begin);
+    auto* collection = hash_consed(reader, { type, nullptr, elements }, [&] { return make<Collection>(reader, elements, reader.resource()); });
+    reader.close_collection(elements_begin);
+    return collection;
+}
+
 MalList* read_list(Reader& reader)
 {
     reader.next(); // Consume the first '('
-    auto* list = new MalList();
+    auto elements_begin = reader.open_collection();
     for (auto token = reader.peek(); !token.empty(); token = reader.peek()) {
         if (token == ")") {
             reader.next();
-            return list;
+            return make_collection<MalList>(reader, MalType::Type::List, elements_begin);
         }
-        list->push(read_form(reader));
+        reader.add_element(read_form(reader));
     }
     std::cerr << "EOF\n";
-    return list;
+    return make_collection<MalList>(reader, MalType::Type::List, elements_begin);
 }
 
 MalType* read_quote_value(Reader& reader, std::string_view quote_string)
 {
     reader.next(); // Consume the first quote specifier
-    auto* list = new MalList(); // Here, now we made a list, i.e when we 'read' it, it'll be surrounded by ()
-    auto* quote = new MalSymbol(quote_string);
-    list->push(quote);
-    list->push(read_form(reader));
-    return list;
+    // Here, now we make a list, i.e when we 'read' it, it'll be surrounded by ()
+    auto* quote = make_atom<MalSymbol>(reader, quote_string);
+    MalType* elements[] { quote, read_form(reader) };
+    return hash_consed(reader, { MalType::Type::List, nullptr, elements }, [&] { return make<MalList>(reader, elements, reader.resource()); });
 }
 
 MalType* read_with_meta(Reader& reader)
 {
     // ^{"a" 1} [1 2 3] -> (with-meta [1 2 3] {"a" 1})
     reader.next(); // Consume the first '^'
-    auto* list = new MalList(); // Here, now we made a list, i.e when we 'read' it, it'll be surrounded by ()
-    auto* quote = new MalSymbol("with-meta");
-    list->push(quote);
+    // Here, now we make a list, i.e when we 'read' it, it'll be surrounded by ()
+    auto* quote = make_atom<MalSymbol>(reader, "with-meta");
     auto* read_hash_map = read_form(reader);
     auto* read_vector = read_form(reader);
     // Push the vector first, then tha hash map.
-    list->push(read_vector);
-    list->push(read_hash_map);
-    return list;
+    MalType* elements[] { quote, read_vector, read_hash_map };
+    return hash_consed(reader, { MalType::Type::List, nullptr, elements }, [&] { return make<MalList>(reader, elements, reader.resource()); });
 }
 
 // TODO: Combine it with read_list().
 MalVector* read_vector(Reader& reader)
 {
     reader.next(); // Consume the first '['
-    auto* vec = new MalVector();
+    auto elements_begin = reader.open_collection();
 
     for (auto token = reader.peek(); !token.empty(); token = reader.peek()) {
         if (token == "]") {
             reader.next();
-            return vec;
+            return make_collection<MalVector>(reader, MalType::Type::Vector, elements_begin);
         }
-        vec->push(read_form(reader));
+        reader.add_element(read_form(reader));
     }
     std::cerr << "EOF\n";
-    return vec;
+    return make_collection<MalVector>(reader, MalType::Type::Vector, elements_begin);
 }
 
 MalHashMap* read_hash_map(Reader& reader)
 {
     reader.next(); // Consume the first '{'
-    auto* hash_map = new MalHashMap();
+    auto elements_begin = reader.open_collection();
+    auto make_hash_map = [&reader, elements_begin] {
+        return make_collection<MalHashMap>(reader, MalType::Type::HashMap, elements_begin);
+    };
 
     for (auto token = reader.peek(); !token.empty(); token = reader.peek()) {
         if (token == "}") {
             reader.next();
-            return hash_map;
+            return make_hash_map();
         }
-        auto* key = read_form(reader);
+        reader.add_element(read_form(reader));
 
         if (reader.peek() == "}") {
             std::cerr << "EOF. Map value is missing!\n";
             reader.next();
-            return hash_map;
+            return make_hash_map();
         }
-        auto* value = read_form(reader);
-        hash_map->insert_or_assign(key, value);
+        reader.add_element(read_form(reader));
     }
     std::cerr << "EOF\n";
-    return hash_map;
+    return make_hash_map();
+}
+
+MalHashSet* read_hash_set(Reader& reader)
+{
+    reader.next(); // Consume the first '#{'
+    auto elements_begin = reader.open_collection();
+
+    for (auto token = reader.peek(); !token.empty(); token = reader.peek()) {
+        if (token == "}") {
+            reader.next();
+            return make_collection<MalHashSet>(reader, MalType::Type::HashSet, elements_begin);
+        }
+        reader.add_element(read_form(reader));
+    }
+    std::cerr << "EOF\n";
+    return make_collection<MalHashSet>(reader, MalType::Type::HashSet, elements_begin);
 }
 
 MalType* read_atom(Reader& reader)
 {
-    return new MalSymbol { reader.next() }; // TODO: Time for a read_symbol()?
+    return make_atom<MalSymbol>(reader, reader.next()); // TODO: Time for a read_symbol()?
 }
 
 MalType* read_string(Reader& reader)
 {
     auto token = reader.next();
-    return new MalString { token.substr(1, token.size() - 2)};
+    return make_atom<MalString>(reader, token.substr(1, token.size() - 2));
 }
 
 MalType* read_keyword(Reader& reader)
 {
-    return new MalKeyword { reader.next() };
+    // Keywords are always interned, whatever the ReadMode, so they never come from the arena.
+    return MalKeyword::intern(reader.next());
 }
 
 MalType* read_nil(Reader& reader)
 {
     reader.next();
-    return new MalNil();
+    return make_atom<MalNil>(reader);
 }
 
 MalType* read_false(Reader& reader)
 {
     reader.next();
-    return new MalFalse();
+    return make_atom<MalFalse>(reader);
 }
 
 MalType* read_true(Reader& reader)
 {
     reader.next();
-    return new MalTrue();
+    return make_atom<MalTrue>(reader);
 }
 
 MalType* read_integer(Reader& reader)
@@ -179,12 +555,44 @@ MalType* read_integer(Reader& reader)
     long int extracted_number { 0 };
     auto [ptr, error_code] = std::from_chars(token.begin(), token.end(), extracted_number);
     if (error_code == std::errc())
-        return new MalInteger { extracted_number };
+        return make_atom<MalInteger>(reader, extracted_number);
+    if (error_code == std::errc::result_out_of_range)
+        return make_atom<MalBigInteger>(reader, BigInteger::from_string(token));
 
     std::cerr << "EOF, read_integer(): error while reading a number. Should never happen!\n";
     return {};
 }
 
+MalType* read_float(Reader& reader)
+{
+    auto token = reader.next();
+    if (token == "##Inf")
+        return make_atom<MalFloat>(reader, HUGE_VAL);
+    if (token == "##-Inf")
+        return make_atom<MalFloat>(reader, -HUGE_VAL);
+    if (token == "##NaN")
+        return make_atom<MalFloat>(reader, std::nan(""));
+
+    double extracted_number { 0 };
+    auto [ptr, error_code] = std::from_chars(token.begin(), token.end(), extracted_number);
+    // -0.0 == 0.0, so hash-consing would turn one into the other.
+    if (error_code == std::errc() && ptr == token.end() && extracted_number == 0 && std::signbit(extracted_number))
+        return make<MalFloat>(reader, extracted_number);
+    if (error_code == std::errc() && ptr == token.end())
+        return make_atom<MalFloat>(reader, extracted_number);
+    // from_chars() leaves the value alone when it is out of range; strtod() rounds it to infinity or zero.
+    if (error_code == std::errc::result_out_of_range)
+        return make_atom<MalFloat>(reader, std::strtod(std::string(token).c_str(), nullptr));
+
+    std::cerr << "EOF, read_float(): error while reading a number. Should never happen!\n";
+    return {};
+}
+
+bool is_float(std::string_view number)
+{
+    return number.find_first_of(".eE") != std::string_view::npos;
+}
+
 bool is_number(std::string_view str)
 {
     // A naive way to test if str is a number
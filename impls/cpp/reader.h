@@ -1,8 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <charconv>
 #include <cassert>
+#include <deque>
 #include <iostream>
+#include <memory_resource>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -11,6 +15,7 @@ class MalType;
 class MalList;
 class MalVector;
 class MalHashMap;
+class MalHashSet;
 
 class Tokenizer {
 public:
@@ -22,6 +27,7 @@ public:
     std::string_view next()
     {
         auto input_view = std::string_view(m_input);
+        m_incomplete = false;
 
         while (m_index < m_input.length()) {
             auto c = m_input[m_index];
@@ -51,46 +57,51 @@ public:
                 return input_view.substr(m_index++, 1);
             case '"': {
                 auto first_quote_index = m_index;
+                if (!has_closing_quote(m_index + 1)) {
+                    // Leave m_index on the opening quote, so the string can be scanned again once more input arrives.
+                    m_incomplete = true;
+                    return {};
+                }
+                // Unescape in place in one pass, then close the gap the escapes leave once, so that a long
+                // string with many escapes is not shifted once per escape.
                 ++m_index;
-                bool found_closing_quote = false;
-                while (!found_closing_quote && m_index < m_input.length()) {
-                    switch (m_input[m_index]) {
-                        case '\\':
-                            switch (m_input.at(m_index + 1)) {
-                                case '"':
-                                    m_input.replace(m_index, 2, "\"");
-                                    break;
-                                case 'n':
-                                    m_input.replace(m_index, 2, "\n");
-                                    break;
-                                case '\\':
-                                    m_input.replace(m_index, 2, "\\");
-                                    break;
-                                default:
-                                    assert(0);
-                            }
-                            break;
-                        case '"':
-                            found_closing_quote = true;
-                            --m_index;
-                            break;
-                        default:
-                            break;
-
+                auto write_index = m_index;
+                for (; m_input[m_index] != '"'; ++m_index) {
+                    auto character = m_input[m_index];
+                    if (character == '\\') {
+                        switch (m_input.at(++m_index)) {
+                            case '"':
+                                character = '"';
+                                break;
+                            case 'n':
+                                character = '\n';
+                                break;
+                            case '\\':
+                                character = '\\';
+                                break;
+                            default:
+                                assert(0);
+                        }
                     }
-                    ++m_index;
+                    m_input[write_index++] = character;
                 }
-                if (m_index >= m_input.length()) {
-                    std::cerr << "EOF";
-                    return  {};
-                }
-                ++m_index; // To take the ending " as well
+                m_input[write_index++] = '"'; // To take the ending " as well
+                m_input.erase(write_index, m_index + 1 - write_index);
+                m_index = write_index;
                 return input_view.substr(first_quote_index, m_index - first_quote_index);
             }
             case ';': {
                 auto semicolon_index = m_index;
-                m_index = m_input.length();
-                return input_view.substr(semicolon_index, m_input.length() - semicolon_index);
+                m_index = std::min(m_input.find('\n', m_index), m_input.length());
+                return input_view.substr(semicolon_index, m_index - semicolon_index);
+            }
+            case '#': {
+                if (m_index + 1 < m_input.length() && m_input[m_index + 1] == '{') {
+                    m_index += 2;
+                    return input_view.substr(m_index - 2, 2);
+                }
+                // Otherwise '#' starts a symbol; it is not a number either, so this falls through to the default case.
+                [[fallthrough]];
             }
             case '-':
             case '1':
@@ -103,14 +114,19 @@ public:
             case '8':
             case '9': {
                 // TODO: For 123foo, it'll be extracted as '123, foo' tokens, check whether we're okay with that.
-                // FIXME: It's wasteful, to use std::from_chars() just to know the length of the number. However, it may be useful for float types.
-                long int extracted_number { 0 };
-                auto [ptr, error_code] = std::from_chars(input_view.begin() + m_index, input_view.end(), extracted_number);
-                if (error_code == std::errc()) {
-                    auto first_number_index = m_index;
-                    auto number_length = std::distance(input_view.begin() + m_index, ptr);
-                    m_index += number_length;
-                    return input_view.substr(first_number_index, number_length);
+                // Parsing as a double finds the end of integers and floats alike; read_form tells them apart.
+                // A literal out of range is still one number token, read_integer makes it a MalBigInteger.
+                // from_chars() also takes "inf" and "nan", so a number must start with a digit, after any '-'.
+                auto digits_index = m_index + (c == '-');
+                if (digits_index < m_input.length() && m_input[digits_index] >= '0' && m_input[digits_index] <= '9') {
+                    double extracted_number { 0 };
+                    auto [ptr, error_code] = std::from_chars(input_view.begin() + m_index, input_view.end(), extracted_number);
+                    if (error_code == std::errc() || error_code == std::errc::result_out_of_range) {
+                        auto first_number_index = m_index;
+                        auto number_length = std::distance(input_view.begin() + m_index, ptr);
+                        m_index += number_length;
+                        return input_view.substr(first_number_index, number_length);
+                    }
                 }
                 [[fallthrough]]; // To handle inputs like `-` or `-abc`.
             }
@@ -151,15 +167,44 @@ public:
         }
         return {};
     }
+
+    // True if the last next() stopped at an unterminated string.
+    bool incomplete() const { return m_incomplete; }
+
+    size_t index() const { return m_index; }
+    void set_index(size_t index) { m_index = index; }
+
 private:
+    bool has_closing_quote(size_t index) const
+    {
+        while (index < m_input.length()) {
+            if (m_input[index] == '\\')
+                index += 2;
+            else if (m_input[index] == '"')
+                return true;
+            else
+                ++index;
+        }
+        return false;
+    }
+
     std::string& m_input;
     size_t m_index { 0 };
+    bool m_incomplete { false };
+};
+
+enum class ReadMode {
+    Heap, // Every node is a separate heap allocation.
+    Arena, // All nodes of a top-level form, and the element arrays of its collections, come from one contiguous arena.
+    HashConsed, // Structurally equal atoms and collections, across all forms read in this mode, are read as one shared node.
 };
 
 class Reader {
 public:
-    Reader(std::vector<std::string_view>& tokens)
+    Reader(std::vector<std::string_view>& tokens, std::pmr::memory_resource* arena = nullptr, bool hash_consing = false)
         : m_tokens(tokens)
+        , m_arena(arena)
+        , m_hash_consing(hash_consing)
     {
     }
 
@@ -177,20 +222,87 @@ public:
         return {};
     }
 
+    std::pmr::memory_resource* arena() const { return m_arena; }
+    std::pmr::memory_resource* resource() const { return m_arena ? m_arena : std::pmr::get_default_resource(); }
+    bool hash_consing() const { return m_hash_consing; }
+
+    // The elements of all collections being read are collected on one stack, so that every collection
+    // can be created with an exactly sized element array once its closing token is seen.
+    size_t open_collection() const { return m_elements.size(); }
+    void add_element(MalType* element) { m_elements.push_back(element); }
+    std::span<MalType* const> elements_since(size_t begin) const { return std::span(m_elements).subspan(begin); }
+    void close_collection(size_t begin) { m_elements.resize(begin); }
+
 private:
     std::vector<std::string_view>& m_tokens;
     size_t m_index { 0 };
+    std::pmr::memory_resource* m_arena { nullptr };
+    bool m_hash_consing { false };
+    std::vector<MalType*> m_elements;
+};
+
+// Reads top-level forms out of a stream of input chunks (REPL lines or piped stdin).
+// Tokens and nesting state are kept between feed() calls, so a form spread over many chunks
+// is tokenized and parsed exactly once, as soon as its last token arrives.
+class IncrementalReader {
+public:
+    explicit IncrementalReader(ReadMode mode = ReadMode::Heap)
+        : m_mode(mode)
+    {
+    }
+
+    IncrementalReader(IncrementalReader const&) = delete;
+    IncrementalReader& operator=(IncrementalReader const&) = delete;
+
+    void feed(std::string_view chunk);
+    // Marks the end of input: a trailing token is taken as complete, and an unfinished form is reported as EOF.
+    void finish();
+
+    // Returns the next complete top-level form, or nullptr if more input is needed.
+    MalType* next_form();
+
+    bool needs_more_input() const { return !m_tokens.empty() || !m_resume_chars.empty() || m_in_string; }
+
+private:
+    struct TokenSpan {
+        size_t start;
+        size_t length;
+    };
+
+    void scan(bool at_eof);
+    bool string_closed();
+    void drop_form();
+    void subform_completed();
+    void compact();
+    void reset();
+
+    std::string m_buffer;
+    Tokenizer m_tokenizer { m_buffer };
+    std::vector<TokenSpan> m_tokens; // The tokens of the form in progress.
+    std::vector<int> m_open_prefixes; // Forms still owed to top-level ' ` ~ ~@ @ ^ prefixes.
+    std::vector<char> m_closers; // The closing brackets owed to the collections open in the form in progress.
+    std::string_view m_resume_chars; // If the last token was held back, the characters that could end it.
+    // If the buffer ends in an unterminated string, where to go on looking for its closing quote, and
+    // whether the character there is escaped, so that a long string fed line by line is scanned once.
+    bool m_in_string { false };
+    size_t m_string_scan { 0 };
+    bool m_string_escaped { false };
+    std::deque<MalType*> m_forms;
+    ReadMode m_mode { ReadMode::Heap };
 };
 
 std::vector<std::string_view> tokenize(std::string& input);
-MalType* read_str(std::string& input);
+MalType* read_str(std::string& input, ReadMode mode = ReadMode::Heap);
+MalType* read_tokens(std::vector<std::string_view>& tokens, ReadMode mode);
 MalType* read_form(Reader& reader);
 MalType* read_integer(Reader& reader);
+MalType* read_float(Reader& reader);
 MalList* read_list(Reader& reader);
 MalType* read_quote_value(Reader& reader, std::string_view quote_string);
 MalType* read_with_meta(Reader& reader);
 MalVector* read_vector(Reader& reader);
 MalHashMap* read_hash_map(Reader& reader);
+MalHashSet* read_hash_set(Reader& reader);
 MalType* read_atom(Reader& reader);
 MalType* read_string(Reader& reader);
 MalType* read_keyword(Reader& reader);
@@ -198,4 +310,5 @@ MalType* read_nil(Reader& reader);
 MalType* read_false(Reader& reader);
 MalType* read_true(Reader& reader);
 
-bool is_number(std::string_view str);
\ No newline at end of file
+bool is_number(std::string_view str);
+bool is_float(std::string_view number);
\ No newline at end of file
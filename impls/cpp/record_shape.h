@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+class MalType;
+
+// The key layout of a small map whose keys are all keywords: the keys in insertion order, each naming
+// a slot of the map's value array. Shapes are shared, like the hidden classes of JavaScript engines:
+// adding a key to a shape follows a transition to the one shape with those keys in that order, so all
+// records built the same way point to the same Shape and hold nothing but their values.
+// Keywords are interned, so a key is found by comparing pointers. Shapes are never freed.
+class RecordShape {
+public:
+    // Maps with more keys than this use hashing instead.
+    static constexpr std::size_t max_keys = 8;
+
+    static RecordShape const* empty()
+    {
+        static RecordShape const s_empty;
+        return &s_empty;
+    }
+
+    std::size_t size() const { return m_size; }
+    MalType* key(std::size_t index) const { return m_keys[index]; }
+
+    // The slot of key, or size() if this shape does not have it.
+    std::size_t index_of(MalType const* key) const
+    {
+        return std::find(m_keys, m_keys + m_size, key) - m_keys;
+    }
+
+    // This shape plus key, as the last slot. The shape must not already have key, nor be full.
+    // Lock-free: the transitions are a list that only ever grows at its head, so a thread that loses the
+    // race to add one looks again at what the winner added.
+    RecordShape const* with(MalType* key) const
+    {
+        auto const* head = m_transitions.load(std::memory_order_acquire);
+        Transition const* searched_until = nullptr;
+        Transition* added = nullptr;
+        while (true) {
+            for (auto const* transition = head; transition != searched_until; transition = transition->next) {
+                if (transition->key == key) {
+                    if (added) {
+                        delete added->shape;
+                        delete added;
+                    }
+                    return transition->shape;
+                }
+            }
+            searched_until = head;
+            if (!added)
+                added = new Transition { key, new RecordShape(*this, key), nullptr };
+            added->next = head;
+            if (m_transitions.compare_exchange_weak(head, added, std::memory_order_acq_rel, std::memory_order_acquire))
+                return added->shape;
+        }
+    }
+
+    // This shape without the key in slot index; the other keys keep their order.
+    RecordShape const* without(std::size_t index) const
+    {
+        auto const* shape = empty();
+        for (std::size_t i = 0; i < m_size; ++i) {
+            if (i != index)
+                shape = shape->with(m_keys[i]);
+        }
+        return shape;
+    }
+
+private:
+    RecordShape() = default;
+
+    RecordShape(RecordShape const& parent, MalType* key)
+        : m_size(parent.m_size + 1)
+    {
+        std::copy(parent.m_keys, parent.m_keys + parent.m_size, m_keys);
+        m_keys[parent.m_size] = key;
+    }
+
+    struct Transition {
+        MalType* key;
+        RecordShape const* shape;
+        Transition const* next;
+    };
+
+    MalType* m_keys[max_keys] {};
+    std::size_t m_size { 0 };
+    mutable std::atomic<Transition const*> m_transitions { nullptr };
+};
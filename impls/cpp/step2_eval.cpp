@@ -46,6 +46,12 @@ MalType* eval_ast(MalType* ast, Env& env)
             hash_map->insert_or_assign(key, EVAL(value, env));
         return hash_map;
     }
+    case MalType::Type::HashSet: {
+        auto hash_set = new MalHashSet();
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(ast))
+            hash_set->insert(EVAL(element, env));
+        return hash_set;
+    }
     default:
         return ast;
     }
@@ -43,6 +43,12 @@ MalType* eval_ast(MalType* ast, Env& env)
             hash_map->insert_or_assign(key, EVAL(value, env));
         return hash_map;
     }
+    case MalType::Type::HashSet: {
+        auto hash_set = new MalHashSet();
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(ast))
+            hash_set->insert(EVAL(element, env));
+        return hash_set;
+    }
     default:
         return ast;
     }
@@ -68,12 +74,12 @@ MalType* EVAL(MalType* ast, Env& env)
     if (ast_as_list->at(0)->inspect() == "let*") {
         // create a new environment using the current environment as the outer value
         Env let_env(&env);
-        auto* new_bindings = static_cast<MalList*>(ast_as_list->at(1));
-        for (std::size_t i = 0; i < new_bindings->size() - 1; i += 2) {
+        auto* new_bindings = ast_as_list->at(1);
+        for (std::size_t i = 0; i + 1 < sequence_size(new_bindings); i += 2) {
             // then use the first parameter as a list of new bindings in the "let*" environment
-            auto* key = static_cast<MalSymbol*>(new_bindings->at(i));
+            auto* key = static_cast<MalSymbol*>(sequence_at(new_bindings, i));
             // Take the second element of the binding list, call EVAL using the new "let*" environment as the evaluation environment
-            auto* value = EVAL(new_bindings->at(i + 1), let_env);
+            auto* value = EVAL(sequence_at(new_bindings, i + 1), let_env);
             // then call set on the "let*" environment using the first binding list element as the key and the evaluated second element as the value.
             let_env.set(key, value);
         }
@@ -1,16 +1,22 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <unistd.h>
 
 #include "linenoise.hpp"
 
 #include "env.h"
+#include "isolate.h"
 #include "reader.h"
 #include "printer.h"
 #include "types.h"
 #include "core.h"
 
 constexpr auto g_line_history_path = "line_history.txt";
+constexpr std::size_t g_read_chunk_size = 64 * 1024;
 
 
 MalType* READ(std::string& input)
@@ -44,11 +50,82 @@ MalType* eval_ast(MalType* ast, Env& env)
             hash_map->insert_or_assign(key, EVAL(value, env));
         return hash_map;
     }
+    case MalType::Type::HashSet: {
+        auto hash_set = new MalHashSet();
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(ast))
+            hash_set->insert(EVAL(element, env));
+        return hash_set;
+    }
     default:
         return ast;
     }
 }
 
+// Whether evaluating ast may make something that refers to the Env it is evaluated in and outlives the
+// evaluation: a closure or a future. Quoted data is looked into too, which errs on the safe side.
+static bool captures_env(MalType* ast)
+{
+    auto any_captures = [](auto const& sequence) {
+        for (auto* element : sequence) {
+            if (captures_env(element))
+                return true;
+        }
+        return false;
+    };
+    switch (ast->type()) {
+    case MalType::Type::Symbol: {
+        auto const& name = static_cast<MalSymbol*>(ast)->value();
+        return name == "fn*" || name == "future";
+    }
+    case MalType::Type::List:
+        return any_captures(*static_cast<MalList*>(ast));
+    case MalType::Type::Vector:
+        return any_captures(*static_cast<MalVector*>(ast));
+    case MalType::Type::HashMap:
+        for (auto [key, value] : *static_cast<MalHashMap*>(ast)) {
+            if (captures_env(key) || captures_env(value))
+                return true;
+        }
+        return false;
+    case MalType::Type::HashSet:
+        for (auto [element, ignored] : *static_cast<MalHashSet*>(ast)) {
+            if (captures_env(element))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// A fn* whose body cannot capture its Env, with its parameters, which a call binds in a frame on the
+// C++ stack rather than in an Env of its own on the heap. Parameters after & need a list of the rest of
+// the arguments, so such functions keep heap frames.
+struct StackFrameFunction {
+    MalList* form;
+    MalSymbol** parameters;
+    std::size_t parameter_count;
+};
+
+static StackFrameFunction* stack_frame_function(MalList* form)
+{
+    auto* binds = form->at(1);
+    if (captures_env(form->at(2)))
+        return nullptr;
+    auto parameter_count = sequence_size(binds);
+    auto** parameters = static_cast<MalSymbol**>(ThreadLocalHeap::allocate(std::max<std::size_t>(parameter_count, 1) * sizeof(MalSymbol*)));
+    for (std::size_t i = 0; i < parameter_count; ++i) {
+        parameters[i] = static_cast<MalSymbol*>(sequence_at(binds, i));
+        if (parameters[i]->value() == "&")
+            return nullptr;
+    }
+    return new (ThreadLocalHeap::allocate(sizeof(StackFrameFunction))) StackFrameFunction { form, parameters, parameter_count };
+}
+
+// Calls with at most this many arguments evaluate them into an array on the stack. The functions called
+// only read their arguments during the call; a heap frame copies them.
+constexpr std::size_t g_max_stack_arguments = 8;
+
 MalType* EVAL(MalType* ast, Env& env)
 {
     if (!ast)
@@ -70,13 +147,14 @@ MalType* EVAL(MalType* ast, Env& env)
 
     if (ast_as_list->at(0)->inspect() == "let*") {
         // create a new environment using the current environment as the outer value
-        Env let_env(&env);
-        auto* new_bindings = static_cast<MalList*>(ast_as_list->at(1));
-        for (std::size_t i = 0; i < new_bindings->size() - 1; i += 2) {
+        // On the heap, like the environments of fn* calls: a future or a closure made in the body may outlive it.
+        auto& let_env = *new Env(&env);
+        auto* new_bindings = ast_as_list->at(1);
+        for (std::size_t i = 0; i + 1 < sequence_size(new_bindings); i += 2) {
             // then use the first parameter as a list of new bindings in the "let*" environment
-            auto* key = static_cast<MalSymbol*>(new_bindings->at(i));
+            auto* key = static_cast<MalSymbol*>(sequence_at(new_bindings, i));
             // Take the second element of the binding list, call EVAL using the new "let*" environment as the evaluation environment
-            auto* value = EVAL(new_bindings->at(i + 1), let_env);
+            auto* value = EVAL(sequence_at(new_bindings, i + 1), let_env);
             // then call set on the "let*" environment using the first binding list element as the key and the evaluated second element as the value.
             let_env.set(key, value);
         }
@@ -109,19 +187,46 @@ MalType* EVAL(MalType* ast, Env& env)
 
     if (ast_as_list->at(0)->inspect() == "fn*") {
         // Return a new function closure.
+        if (auto* function = stack_frame_function(ast_as_list)) {
+            return new MalFunction { [&env, function](size_t argc, MalType** argv) {
+                // Too few arguments: the heap frame reports them.
+                if (argc < function->parameter_count) {
+                    auto exprs = new MalList(std::span(argv, argc));
+                    return EVAL(function->form->at(2), *new Env { &env, function->form->at(1), exprs });
+                }
+                Env frame { &env, std::span(function->parameters, function->parameter_count), argv };
+                return EVAL(function->form->at(2), frame);
+            } };
+        }
         auto function_closure = [&env, ast_as_list](size_t argc, MalType** argv) {
             auto exprs = new MalList {};
             for (std::size_t i = 0; i < argc; ++i)
                 exprs->push(argv[i]);
-            auto new_env = new Env { &env, static_cast<MalList*>(ast_as_list->at(1)), exprs};
+            auto new_env = new Env { &env, ast_as_list->at(1), exprs};
             return EVAL(ast_as_list->at(2), *new_env);
         };
         return new MalFunction { function_closure };
     }
 
-    auto* new_list = static_cast<MalList*>(eval_ast(ast, env));
-    auto fn = static_cast<MalFunction*>(new_list->at(0))->function_ptr();
-    return fn(new_list->size() - 1, new_list->data() + 1);
+    if (ast_as_list->at(0)->inspect() == "future") {
+        // Evaluate the body on the thread pool; deref or @ waits for its value.
+        auto* body = ast_as_list->at(1);
+        return future_call([body, &env] { return EVAL(body, env); });
+    }
+
+    auto const& function = static_cast<MalFunction*>(EVAL(ast_as_list->at(0), env))->function();
+    auto argc = ast_as_list->size() - 1;
+    auto** elements = ast_as_list->data() + 1;
+    if (argc <= g_max_stack_arguments) {
+        std::array<MalType*, g_max_stack_arguments> arguments;
+        for (std::size_t i = 0; i < argc; ++i)
+            arguments[i] = EVAL(elements[i], env);
+        return function(argc, arguments.data());
+    }
+    std::vector<MalType*> arguments;
+    for (std::size_t i = 0; i < argc; ++i)
+        arguments.push_back(EVAL(elements[i], env));
+    return function(argc, arguments.data());
 }
 
 std::string PRINT(MalType* input)
@@ -129,35 +234,77 @@ std::string PRINT(MalType* input)
     return pr_str(input, true);
 }
 
-std::string rep(std::string& input, Env& env)
+std::string rep(MalType* ast, Env& env)
 {
     try {
-        auto* ast = READ(input);
         auto* result = EVAL(ast, env);
         return PRINT(result);
     } catch (MalException* mal_exception) {
-        std::cerr << mal_exception->what() << std::endl;
+        print_line(mal_exception->what(), std::cerr);
         return {};
     }
 }
 
+std::string rep(std::string& input, Env& env)
+{
+    return rep(READ(input), env);
+}
 
-int main()
+void rep_ready_forms(IncrementalReader& reader, Env& env)
+{
+    while (auto* ast = reader.next_form())
+        print_line(rep(ast, env));
+}
+
+int repl(Env& env)
 {
     linenoise::LoadHistory(g_line_history_path);
 
-    Env env {nullptr};
-    for (auto [symbol, function] : create_core_functions())
-        env.set(symbol, function);
-    std::string not_function = "(def! not (fn* (a) (if a false true)))";
-    rep(not_function, env);
+    // With MAL_HASH_CONS set, equal literals share one node, for data files with many repeated values.
+    // With MAL_READ_ARENA set, each form is read into an arena of its own, for data files with large
+    // literals; the arenas are only freed with the isolate.
+    auto mode = std::getenv("MAL_HASH_CONS") ? ReadMode::HashConsed : std::getenv("MAL_READ_ARENA") ? ReadMode::Arena : ReadMode::Heap;
+    IncrementalReader reader { mode };
+    if (!isatty(STDIN_FILENO)) {
+        // Piped input: evaluate each top-level form as soon as it is complete, whatever the line structure.
+        std::string chunk(g_read_chunk_size, '\0');
+        while (std::cin.read(chunk.data(), chunk.size()) || std::cin.gcount() > 0) {
+            reader.feed(std::string_view(chunk.data(), std::cin.gcount()));
+            rep_ready_forms(reader, env);
+        }
+        reader.finish();
+        rep_ready_forms(reader, env);
+        return 0;
+    }
+
+    // With MAL_MULTILINE set, an unbalanced line asks for more input instead of being an EOF error.
+    bool multiline = std::getenv("MAL_MULTILINE");
     while (true) {
         std::string input;
-        if (linenoise::Readline("user> ", input))
+        if (linenoise::Readline(reader.needs_more_input() ? "  ...> " : "user> ", input))
             break;
-        std::cout << rep(input, env) << '\n';
         linenoise::AddHistory(input.c_str());
+        reader.feed(input + '\n');
+        if (!multiline)
+            reader.finish();
+        rep_ready_forms(reader, env);
     }
 
     linenoise::SaveHistory(g_line_history_path);
-}
\ No newline at end of file
+    return 0;
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env {nullptr};
+    for (auto [symbol, function] : create_core_functions())
+        core_env.set(symbol, function);
+    std::string not_function = "(def! not (fn* (a) (if a false true)))";
+    rep(not_function, core_env);
+
+    // The REPL's definitions go in an isolate's env, on top of the core one. The isolate is never destroyed,
+    // as futures may still be running on its values when the REPL exits.
+    auto* isolate = new Isolate(core_env);
+    return isolate->run(repl);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+
+// What the test_*.cpp programs share. CHECK reports a condition that does not hold and goes on with the
+// test; main returns test_result(), so that make test fails if any check did.
+
+inline int g_failed_checks = 0;
+
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            ++g_failed_checks;                                                             \
+        }                                                                                  \
+    } while (0)
+
+inline int test_result()
+{
+    if (g_failed_checks)
+        std::cerr << g_failed_checks << " checks failed\n";
+    return g_failed_checks ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+// Runs code in isolates the way an embedder does, through Isolate::run and the core builtins, and
+// checks what isolates share and what they keep apart.
+#include <string>
+#include <vector>
+
+#include "core.h"
+#include "isolate.h"
+#include "chunk_recycler.h"
+#include "printer.h"
+#include "reader.h"
+#include "test.h"
+
+static MalType* call(Env& env, char const* name, std::vector<MalType*> arguments)
+{
+    MalSymbol symbol { name };
+    return static_cast<MalFunction*>(env.get(&symbol))->function()(arguments.size(), arguments.data());
+}
+
+// read_str tokenizes its input in place, so it takes a copy.
+static MalType* read(std::string input)
+{
+    return read_str(input);
+}
+
+// A literal big enough to take chunks of its own in a region.
+static std::string make_literal(std::size_t records)
+{
+    std::string literal = "[";
+    for (std::size_t i = 0; i < records; ++i)
+        literal += "{:id " + std::to_string(i) + " :name \"record\"} ";
+    return literal + "]";
+}
+
+static void test_isolates(Env& core_env)
+{
+    auto* symbol = new MalSymbol("records");
+    auto literal = make_literal(10000);
+
+    // What an isolate defines lives in its region and its env, and the core env is seen from both.
+    auto* sender = new Isolate(core_env);
+    Isolate receiver { core_env };
+    auto before = sender->region().allocated_bytes();
+    sender->run([&](Env& env) { env.set(symbol, read(literal)); });
+    CHECK(sender->region().allocated_bytes() > before);
+    CHECK(sender->run([&](Env& env) { return env.find(symbol); }) != nullptr);
+    CHECK(receiver.run([&](Env& env) { return env.find(symbol); }) == nullptr);
+    CHECK(receiver.run([&](Env& env) { return pr_str(call(env, "+", { new MalInteger(1), new MalInteger(2) })); }) == "3");
+
+    // A value sent on a channel is copied out of the sender's region, so it outlives the sender, even
+    // once the chunks of that region have been handed out again.
+    auto* channel = sender->run([&](Env& env) { return call(env, "chan", { new MalInteger(1) }); });
+    sender->run([&](Env& env) { call(env, ">!!", { channel, env.get(symbol) }); });
+    delete sender;
+    receiver.run([&](Env&) { read(literal); });
+    auto* received = receiver.run([&](Env& env) { return call(env, "<!!", { channel }); });
+    auto* expected = read(literal);
+    CHECK(received->type() == MalType::Type::Vector);
+    CHECK(*received == *expected);
+}
+
+// Fills the isolate's region with chunks of garbage, up to what the ChunkRecycler takes back on the
+// spot, so that the pool shows when the region is freed.
+static void make_garbage(Isolate& isolate)
+{
+    isolate.run([&](Env&) {
+        while (isolate.region().allocated_bytes() < 8 * ThreadLocalHeap::chunk_size)
+            read("{:id 1 :name \"garbage\"}");
+    });
+}
+
+static void test_compact_handle(Env& core_env)
+{
+    auto& recycler = ChunkRecycler::instance();
+    auto literal = make_literal(100);
+
+    // A handle on the compacted copy does not keep the isolate's region: once the isolate and the
+    // original handle are gone, its chunks are back in the pool.
+    auto* isolate = new Isolate(core_env);
+    make_garbage(*isolate);
+    auto handle = isolate->keep(isolate->run([&](Env&) { return read(literal); }));
+    auto compacted = compact_handle(handle);
+    auto chunks = isolate->region().allocated_bytes() / ThreadLocalHeap::chunk_size;
+    auto pooled = recycler.pooled_chunks();
+    handle = Isolate::Handle();
+    delete isolate;
+    CHECK(recycler.pooled_chunks() >= pooled + chunks);
+
+    // The copy is intact once those chunks have been handed out again.
+    Isolate reuser { core_env };
+    make_garbage(reuser);
+    CHECK(*compacted.get() == *read(literal));
+
+    // Without compacting, a handle on the same small value keeps every chunk of the region.
+    isolate = new Isolate(core_env);
+    make_garbage(*isolate);
+    handle = isolate->keep(isolate->run([&](Env&) { return read(literal); }));
+    pooled = recycler.pooled_chunks();
+    delete isolate;
+    CHECK(recycler.pooled_chunks() == pooled);
+    handle = Isolate::Handle();
+    CHECK(recycler.pooled_chunks() >= pooled + chunks);
+}
+
+int main()
+{
+    Isolate::initialize();
+    Env core_env { nullptr };
+    for (auto [symbol, function] : create_core_functions())
+        core_env.set(symbol, function);
+
+    // Before test_isolates, whose big regions the sweeper thread recycles while the pool is counted here.
+    test_compact_handle(core_env);
+    test_isolates(core_env);
+    return test_result();
+}
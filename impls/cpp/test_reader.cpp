@@ -0,0 +1,156 @@
+// Feeds the readers input the way the REPL does, in chunks that split forms, tokens and strings, and
+// checks the forms they read in each ReadMode.
+#include <sstream>
+#include <string>
+
+#include "printer.h"
+#include "reader.h"
+#include "test.h"
+#include "types.h"
+
+// The next form reader has ready, printed as str would, or "" if it has none.
+static std::string next_printed(IncrementalReader& reader)
+{
+    auto* form = reader.next_form();
+    return form ? pr_str(form, false) : "";
+}
+
+// read_str tokenizes its input in place, so it takes a copy.
+static MalType* read(std::string input, ReadMode mode = ReadMode::Heap)
+{
+    return read_str(input, mode);
+}
+
+// What the reader reports on std::cerr while it is alive.
+class CapturedErrors {
+public:
+    CapturedErrors()
+        : m_old(std::cerr.rdbuf(m_errors.rdbuf()))
+    {
+    }
+
+    ~CapturedErrors() { std::cerr.rdbuf(m_old); }
+
+    std::string text() const { return m_errors.str(); }
+
+private:
+    std::ostringstream m_errors;
+    std::streambuf* m_old;
+};
+
+static void test_incremental_reader()
+{
+    IncrementalReader reader;
+
+    // A form is read once its last chunk arrives, and several forms in one chunk are read in order.
+    reader.feed("(+ 1");
+    CHECK(reader.needs_more_input());
+    CHECK(next_printed(reader) == "");
+    reader.feed(" 2)\n3 [4 5]");
+    CHECK(next_printed(reader) == "(+ 1 2)");
+    CHECK(next_printed(reader) == "3");
+    CHECK(next_printed(reader) == "[4 5]");
+    CHECK(!reader.needs_more_input());
+
+    // A symbol touching the end of a chunk may go on in the next one.
+    reader.feed("(fo");
+    reader.feed("o bar");
+    reader.feed(")");
+    CHECK(next_printed(reader) == "(foo bar)");
+
+    // A prefix waits for the form it applies to.
+    reader.feed("'");
+    CHECK(reader.needs_more_input());
+    reader.feed("(a)");
+    CHECK(next_printed(reader) == "(quote (a))");
+
+    // A string fed line by line, with escapes split across chunks.
+    reader.feed("\"one\n");
+    CHECK(reader.needs_more_input());
+    reader.feed("two \\");
+    reader.feed("\" three\n");
+    CHECK(next_printed(reader) == "");
+    reader.feed("four\\");
+    reader.feed("\\\" 6");
+    reader.feed(" ");
+    CHECK(next_printed(reader) == "one\ntwo \" three\nfour\\");
+    CHECK(next_printed(reader) == "6");
+
+    // Brackets must match: a wrong closer is reported as soon as it is seen, and the form is dropped.
+    {
+        CapturedErrors errors;
+        reader.feed("(1 2]");
+        CHECK(errors.text() == "Expected ')', got ']'\n");
+        CHECK(next_printed(reader) == "");
+        CHECK(!reader.needs_more_input());
+    }
+    {
+        CapturedErrors errors;
+        reader.feed(") {:a [1}");
+        CHECK(errors.text() == "Unexpected ')'\nExpected ']', got '}'\n");
+    }
+    reader.feed("#{(2)}");
+    CHECK(next_printed(reader) == "#{(2)}");
+
+    // At the end of input, an unfinished form or string is EOF.
+    {
+        CapturedErrors errors;
+        reader.feed("(1 \"2");
+        reader.finish();
+        CHECK(errors.text() == "EOF\n");
+        CHECK(next_printed(reader) == "");
+        CHECK(!reader.needs_more_input());
+    }
+    reader.feed("7");
+    reader.finish();
+    CHECK(next_printed(reader) == "7");
+}
+
+static void test_arena_read_mode()
+{
+    std::string literal = "[[1 2 3] {:a 4} (5 [6 \"seven\"]) 8]";
+    auto* heap_form = read(literal);
+    auto* arena_form = read(literal, ReadMode::Arena);
+    CHECK(pr_str(arena_form) == pr_str(heap_form));
+    CHECK(*arena_form == *heap_form);
+
+    // The nodes of a form come from its arena in depth-first order.
+    auto* vector = static_cast<MalVector*>(read("[1 [2 3 [4]] 5]", ReadMode::Arena));
+    auto* inner = static_cast<MalVector*>(vector->at(1));
+    MalType* in_read_order[] { vector->at(0), inner->at(0), inner->at(1), static_cast<MalVector*>(inner->at(2))->at(0), vector->at(2) };
+    for (std::size_t i = 1; i < std::size(in_read_order); ++i)
+        CHECK(in_read_order[i - 1] < in_read_order[i]);
+    auto* first = reinterpret_cast<char*>(in_read_order[0]);
+    CHECK(reinterpret_cast<char*>(vector) > first && reinterpret_cast<char*>(vector) - first < 1024);
+}
+
+static void test_hash_consed_read_mode()
+{
+    // Equal subtrees of a form, and of forms read later, are read as one node.
+    std::string records = "[{:name \"ada\" :tags [1 2]} {:name \"ada\" :tags [1 2]} (\"ada\" 2.5)]";
+    auto* vector = static_cast<MalVector*>(read(records, ReadMode::HashConsed));
+    auto* record = static_cast<MalHashMap*>(vector->at(0));
+    auto* list = static_cast<MalList*>(vector->at(2));
+    CHECK(vector->at(1) == record);
+    CHECK(record->find(read(":name")) == list->at(0));
+    auto* later = static_cast<MalVector*>(read("[[1 2] \"ada\" 2.5]", ReadMode::HashConsed));
+    CHECK(later->at(0) == record->find(read(":tags")));
+    CHECK(later->at(1) == list->at(0));
+    CHECK(later->at(2) == list->at(1));
+
+    // Equal values of different types stay apart, and the result compares like a heap read.
+    auto* mixed = static_cast<MalVector*>(read("[(1 2) [1 2] 1 1.0]", ReadMode::HashConsed));
+    CHECK(mixed->at(0) != mixed->at(1));
+    CHECK(mixed->at(2) != mixed->at(3));
+    auto* heap_vector = static_cast<MalVector*>(read(records));
+    CHECK(heap_vector->at(0) != heap_vector->at(1));
+    CHECK(*heap_vector == *vector);
+}
+
+int main()
+{
+    test_incremental_reader();
+    test_arena_read_mode();
+    test_hash_consed_read_mode();
+    return test_result();
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+#include "chunk_recycler.h"
+
+// Bump allocation from a buffer owned by the calling thread, for the MalType nodes that evaluation makes
+// by the million: no lock and no free-list search, just a pointer increment. A thread takes a new chunk
+// from the global heap when its buffer runs out.
+// Nodes are never freed, like every other value in this interpreter, so a node allocated by one thread
+// may be used by any other for as long as the process lives, and a thread may exit with its buffer.
+// The exception is a Region (see isolate.h): while a thread has a Scope for one, its nodes come from the
+// region's own buffer instead, and are all freed at once with the region. A destroyed region's chunks go
+// to the ChunkRecycler, which frees them on a thread of its own and keeps some for new buffers to reuse.
+class ThreadLocalHeap {
+    struct Buffer {
+        std::uintptr_t next;
+        std::uintptr_t end;
+    };
+
+public:
+    static constexpr std::size_t chunk_size = ChunkRecycler::chunk_size;
+    // Bigger requests go straight to the global heap, so that they do not waste most of a chunk.
+    static constexpr std::size_t max_small_size = chunk_size / 16;
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    // Memory that lives as long as the Region rather than the process. Only one thread at a time may
+    // allocate from a region. Its chunks double in size from the first one up to chunk_size, so that a
+    // region made for a small value stays small.
+    class Region {
+    public:
+        explicit Region(std::size_t first_chunk_size = chunk_size)
+            : m_next_chunk_size(first_chunk_size)
+        {
+        }
+
+        Region(Region const&) = delete;
+        Region& operator=(Region const&) = delete;
+
+        // Takes as long as handing the chunk list over, however big the region is.
+        ~Region() { ChunkRecycler::instance().release(std::move(m_chunks)); }
+
+        std::size_t allocated_bytes() const { return m_allocated_bytes; }
+
+        // Takes over the memory of other, which must not be used again: whatever was allocated from it
+        // now lives as long as this region.
+        void adopt(Region& other)
+        {
+            m_chunks.insert(m_chunks.end(), other.m_chunks.begin(), other.m_chunks.end());
+            m_allocated_bytes += other.m_allocated_bytes;
+            other.m_chunks.clear();
+            other.m_allocated_bytes = 0;
+        }
+
+    private:
+        friend class ThreadLocalHeap;
+
+        void* add_chunk(std::size_t size)
+        {
+            auto* memory = size == chunk_size ? ChunkRecycler::instance().acquire() : ::operator new(size);
+            m_chunks.push_back({ memory, size });
+            m_allocated_bytes += size;
+            return memory;
+        }
+
+        std::size_t next_chunk_size()
+        {
+            auto size = m_next_chunk_size;
+            m_next_chunk_size = std::min(size * 2, chunk_size);
+            return size;
+        }
+
+        std::vector<ChunkRecycler::Chunk> m_chunks;
+        std::size_t m_allocated_bytes { 0 };
+        std::size_t m_next_chunk_size;
+        Buffer m_buffer {};
+    };
+
+    // Makes the calling thread allocate from region, or from its own buffer if region is null, until
+    // the scope ends.
+    class Scope {
+    public:
+        explicit Scope(Region* region)
+            : m_previous(s_region)
+        {
+            s_region = region;
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+        ~Scope() { s_region = m_previous; }
+
+    private:
+        Region* m_previous;
+    };
+
+    static void* allocate(std::size_t size)
+    {
+        auto* region = s_region;
+        if (size > max_small_size)
+            return region ? region->add_chunk(size) : ::operator new(size);
+        size = (size + alignment - 1) & ~(alignment - 1);
+        auto& buffer = region ? region->m_buffer : s_buffer;
+        if (buffer.end - buffer.next < size) {
+            auto new_chunk_size = region ? std::max(region->next_chunk_size(), size) : chunk_size;
+            buffer.next = reinterpret_cast<std::uintptr_t>(region ? region->add_chunk(new_chunk_size) : ChunkRecycler::instance().acquire());
+            buffer.end = buffer.next + new_chunk_size;
+        }
+        auto* memory = reinterpret_cast<void*>(buffer.next);
+        buffer.next += size;
+        return memory;
+    }
+
+    static Region* current_region() { return s_region; }
+
+    // A memory resource that allocates from the calling thread's region if it has one, and from the global
+    // heap otherwise. Installed as the default resource, it makes the element arrays and trie nodes of
+    // collections built in a region come from the region too. Like the nodes, the memory is never
+    // deallocated one piece at a time.
+    static std::pmr::memory_resource* resource()
+    {
+        static RegionResource s_resource;
+        return &s_resource;
+    }
+
+private:
+    class RegionResource : public std::pmr::memory_resource {
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            if (!s_region || alignment > ThreadLocalHeap::alignment)
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            return ThreadLocalHeap::allocate(bytes);
+        }
+
+        void do_deallocate(void*, std::size_t, std::size_t) override { }
+
+        bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+    };
+
+    static inline thread_local Buffer s_buffer {};
+    static inline thread_local Region* s_region { nullptr };
+};
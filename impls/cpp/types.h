@@ -1,16 +1,70 @@
 #pragma once
 
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <exception>
 #include <functional>
 #include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <unordered_map>
 
+#include "big_integer.h"
+#include "channel.h"
+#include "persistent_hash_map.h"
+#include "persistent_sorted_map.h"
+#include "persistent_vector.h"
+#include "record_shape.h"
+#include "thread_local_heap.h"
+
+class MalException : public std::exception {
+public:
+    MalException(std::string_view message)
+        : m_message(message)
+    {
+    }
+
+    char const* what() const noexcept  override { return m_message.c_str(); }
+
+private:
+    std::string m_message;
+};
+
+// Threading model: any number of threads may evaluate at once, sharing values and the global Env.
+// - Values are immutable once made and published, so reading one from any thread needs no lock. The few
+//   that change behind the scenes do so with atomics: a list claiming a free slot of its storage, a rope
+//   caching its flat copy, a RecordShape adding a transition.
+// - Tables shared by all threads are locked: the keyword intern table (a shared_mutex, as lookups far
+//   outnumber new keywords) and the reader's hash-consing table.
+// - An Env publishes its bindings as an immutable map through an atomic pointer: readers never wait,
+//   and def! swaps in an updated copy with a compare-and-swap (see env.h).
+// - An atom is the same thing for user code: an atomic pointer to an immutable value, which swap!
+//   replaces with a compare-and-swap (see MalAtom).
+// - Channels pass values from thread to thread through a lock-free ring (see Channel).
+// - MalType nodes come from a buffer owned by the allocating thread (see ThreadLocalHeap), or from the
+//   region of the isolate the thread is running (see isolate.h).
+// - Transients and string builders belong to the thread that made them, as in Clojure; they are not
+//   meant to be shared.
+// - prn and println print each line with a single locked write (see print_line()).
 class MalType {
 public:
+    static void* operator new(std::size_t size) { return ThreadLocalHeap::allocate(size); }
+    static void* operator new(std::size_t, void* place) noexcept { return place; }
+    // Nodes are never freed.
+    static void operator delete(void*) noexcept { }
+    static void operator delete(void*, void*) noexcept { }
+
     // A quick&dirty non-RTTI solution.
     enum class Type {
         List,
@@ -21,9 +75,21 @@ public:
         False,
         True,
         Integer,
+        BigInteger,
+        Float,
+        NumArray,
         Function,
         String,
-        Keyword
+        Keyword,
+        TransientVector,
+        TransientHashMap,
+        SortedMap,
+        SortedSet,
+        HashSet,
+        StringBuilder,
+        Future,
+        Atom,
+        Channel
     };
 
     std::string type_as_string()
@@ -37,9 +103,21 @@ public:
         case Type::False: return "False";
         case Type::True: return "True";
         case Type::Integer: return "Integer";
+        case Type::BigInteger: return "BigInteger";
+        case Type::Float: return "Float";
+        case Type::NumArray: return "NumArray";
         case Type::Function: return "Function";
         case Type::String: return "String";
         case Type::Keyword: return "Keyword";
+        case Type::TransientVector: return "TransientVector";
+        case Type::TransientHashMap: return "TransientHashMap";
+        case Type::SortedMap: return "SortedMap";
+        case Type::SortedSet: return "SortedSet";
+        case Type::HashSet: return "HashSet";
+        case Type::StringBuilder: return "StringBuilder";
+        case Type::Future: return "Future";
+        case Type::Atom: return "Atom";
+        case Type::Channel: return "Channel";
         default: return "Unkown!";
         }
     }
@@ -47,136 +125,626 @@ public:
     virtual std::string inspect(bool print_readably = false) const = 0;
     virtual Type type() const = 0;
     virtual bool operator==(MalType const&) const = 0;
+
+    // Values that are equal must hash equally.
+    virtual std::size_t hash() const { return std::hash<std::string>{}(inspect(true)); }
+};
+
+// The elements of one or more lists. Slots in [front, back) are in use and never change again.
+// A list that starts at front, or ends at back, may claim the free slot next to it without copying,
+// since no other list can see that slot.
+// Lists on different threads may race for the same free slot, so claiming one is a compare-and-swap.
+struct ListStorage {
+    MalType** slots;
+    std::size_t capacity;
+    std::atomic<std::size_t> front;
+    std::atomic<std::size_t> back;
+
+    bool claim_front(std::size_t front_now) { return front_now > 0 && front.compare_exchange_strong(front_now, front_now - 1); }
+    bool claim_back(std::size_t back_now) { return back_now < capacity && back.compare_exchange_strong(back_now, back_now + 1); }
 };
 
+// A view of size elements of a ListStorage, so that rest is O(1) and cons is amortized O(1).
 class MalList : public MalType {
 public:
+    MalList() = default;
+
+    MalList(std::span<MalType* const> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_resource(resource)
+    {
+        reallocate(elements.size(), 0);
+        std::copy(elements.begin(), elements.end(), m_storage->slots);
+        m_storage->back = m_size = elements.size();
+    }
+
     void push(MalType* mal_type)
     {
-        m_list.push_back(mal_type);
+        if (!m_storage || !m_storage->claim_back(m_offset + m_size)) {
+            reallocate(std::max<std::size_t>(4, m_size * 2), 0);
+            ++m_storage->back;
+        }
+        m_storage->slots[m_offset + m_size] = mal_type;
+        ++m_size;
+    }
+
+    // A list of the elements from index on, sharing this list's storage.
+    MalList* slice(std::size_t index) const
+    {
+        auto* list = new MalList(*this);
+        index = std::min(index, m_size);
+        list->m_offset += index;
+        list->m_size -= index;
+        return list;
+    }
+
+    MalList* rest() const { return slice(1); }
+
+    MalList* cons(MalType* mal_type) const
+    {
+        auto* list = new MalList(*this);
+        // This list's resource may be the arena it was read into, which only its reader may use.
+        list->m_resource = std::pmr::get_default_resource();
+        if (!m_storage || !m_storage->claim_front(m_offset)) {
+            // Leave as much room in front as there are elements, so that a chain of conses copies O(n) in total.
+            auto room = std::max<std::size_t>(4, m_size);
+            list->reallocate(room + m_size, room);
+            --list->m_storage->front;
+        }
+        list->m_storage->slots[--list->m_offset] = mal_type;
+        ++list->m_size;
+        return list;
     }
 
     std::string inspect(bool print_readably = false) const override
     {
         std::string result = "(";
-        for (auto* mal_type : m_list)
+        for (auto* mal_type : *this)
             result.append(mal_type->inspect(print_readably) + " ");
 
-        if (m_list.size() > 0)
+        if (m_size > 0)
             result[result.length() - 1] = ')';
         else
             result.append(")");
         return result;
     }
 
-    bool operator==(MalType const& other) const override
-    {
-        if (type() != other.type() && other.type() != Type::Vector)
-            return false;
-        if (size() != static_cast<MalList const&>(other).size())
-            return false;
-        for (std::size_t i = 0; i < size(); ++i) {
-            if (*m_list[i] != *static_cast<MalList const&>(other).m_list[i])
-                return false;
-        }
-        return true;
-    }
+    bool operator==(MalType const& other) const override;
+    std::size_t hash() const override;
 
-    // TODO: Add the other 4? const ones.
-    auto begin() { return m_list.begin(); }
-    auto end() { return m_list.end(); }
+    MalType** begin() const { return data(); }
+    MalType** end() const { return data() + m_size; }
 
-    auto at(size_t index) const { return m_list.at(index); }
+    MalType* at(size_t index) const
+    {
+        if (index >= m_size)
+            throw std::out_of_range("MalList::at");
+        return data()[index];
+    }
 
-    auto data() { return m_list.data(); }
+    MalType** data() const { return m_storage ? m_storage->slots + m_offset : nullptr; }
 
-    auto empty() const { return m_list.empty(); }
-    std::size_t size() const { return m_list.size(); }
+    auto empty() const { return m_size == 0; }
+    std::size_t size() const { return m_size; }
 
     Type type() const override { return Type::List; }
 
 private:
-    std::vector<MalType*> m_list { };
+    // Moves this list's elements to new storage, starting at offset front_room.
+    void reallocate(std::size_t capacity, std::size_t front_room)
+    {
+        auto* storage = static_cast<ListStorage*>(m_resource->allocate(sizeof(ListStorage), alignof(ListStorage)));
+        auto* slots = static_cast<MalType**>(m_resource->allocate(std::max<std::size_t>(capacity, 1) * sizeof(MalType*), alignof(MalType*)));
+        std::copy(begin(), end(), slots + front_room);
+        m_storage = new (storage) ListStorage { slots, capacity, front_room, front_room + m_size };
+        m_offset = front_room;
+    }
+
+    std::pmr::memory_resource* m_resource { std::pmr::get_default_resource() };
+    ListStorage* m_storage { nullptr };
+    std::size_t m_offset { 0 };
+    std::size_t m_size { 0 };
 };
 
 class MalVector : public MalType {
 public:
+    MalVector() = default;
+
+    MalVector(PersistentVector vector)
+        : m_vector(vector)
+    {
+    }
+
+    MalVector(std::span<MalType* const> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_vector(elements, resource)
+    {
+    }
+
+    // Only for a vector that is still being built and not yet shared, which may then own its nodes.
     void push(MalType* mal_type)
     {
-        m_list.push_back(mal_type);
+        if (!m_vector.is_transient())
+            m_vector = m_vector.transient();
+        m_vector.conj_in_place(mal_type);
     }
 
+    MalVector* conj(MalType* mal_type) const { return new MalVector(m_vector.conj(mal_type)); }
+    MalVector* assoc(std::size_t index, MalType* mal_type) const { return new MalVector(m_vector.assoc(index, mal_type)); }
+
     std::string inspect(bool print_readably = false) const override
     {
         std::string result = "[";
-        for (auto* mal_type : m_list)
+        for (auto* mal_type : m_vector)
             result.append(mal_type->inspect(print_readably) + " ");
 
-        if (m_list.size() > 0)
+        if (m_vector.size() > 0)
             result[result.length() - 1] = ']';
         else
             result.append("]");
         return result;
     }
 
-    bool operator==(MalType const& other) const override
-    {
-        if (type() != other.type() && other.type() != Type::List)
-            return false;
-        if (size() != static_cast<MalVector const&>(other).size())
-            return false;
-        for (std::size_t i = 0; i < size(); ++i) {
-            if (*m_list[i] != *static_cast<MalVector const&>(other).m_list[i])
-                return false;
-        }
-        return true;
-    }
+    bool operator==(MalType const& other) const override;
+    std::size_t hash() const override;
+
+    auto begin() const { return m_vector.begin(); }
+    auto end() const { return m_vector.end(); }
 
-    auto begin() { return m_list.begin(); }
-    auto end() { return m_list.end(); }
-    std::size_t size() const { return m_list.size(); }
+    MalType* at(std::size_t index) const { return m_vector.nth(index); }
+
+    bool empty() const { return m_vector.empty(); }
+    std::size_t size() const { return m_vector.size(); }
+
+    PersistentVector const& persistent_vector() const { return m_vector; }
 
     Type type() const override { return Type::Vector; }
 
 private:
-    std::vector<MalType*> m_list { };
+    PersistentVector m_vector;
 };
 
+// Lists and vectors are equal if they have equal elements in the same order.
+template<typename LeftSequence, typename RightSequence>
+bool sequences_equal(LeftSequence const& left, RightSequence const& right)
+{
+    if (left.size() != right.size())
+        return false;
+    auto right_it = right.begin();
+    for (auto* element : left) {
+        // Shared (for example hash-consed) elements are equal without looking inside them.
+        if (element != *right_it && *element != **right_it)
+            return false;
+        ++right_it;
+    }
+    return true;
+}
+
+template<typename Sequence>
+bool sequence_equals(Sequence const& sequence, MalType const& other)
+{
+    switch (other.type()) {
+    case MalType::Type::List:
+        return sequences_equal(sequence, static_cast<MalList const&>(other));
+    case MalType::Type::Vector:
+        return sequences_equal(sequence, static_cast<MalVector const&>(other));
+    default:
+        return false;
+    }
+}
+
+// Equal lists and vectors must hash equally, so both hash only their elements.
+template<typename Sequence>
+std::size_t sequence_hash(Sequence const& sequence)
+{
+    std::size_t result = 1;
+    for (auto* element : sequence)
+        result = result * 31 + element->hash();
+    return result;
+}
+
+inline bool MalList::operator==(MalType const& other) const { return sequence_equals(*this, other); }
+inline bool MalVector::operator==(MalType const& other) const { return sequence_equals(*this, other); }
+inline std::size_t MalList::hash() const { return sequence_hash(*this); }
+inline std::size_t MalVector::hash() const { return sequence_hash(*this); }
+
+// let* bindings and fn* parameters may be written either as a list or as a vector.
+inline std::size_t sequence_size(MalType* sequence)
+{
+    if (sequence->type() == MalType::Type::Vector)
+        return static_cast<MalVector*>(sequence)->size();
+    return static_cast<MalList*>(sequence)->size();
+}
+
+inline MalType* sequence_at(MalType* sequence, std::size_t index)
+{
+    if (sequence->type() == MalType::Type::Vector)
+        return static_cast<MalVector*>(sequence)->at(index);
+    return static_cast<MalList*>(sequence)->at(index);
+}
+
 struct HashMalHashMap {
     std::size_t operator()(MalType* key) const noexcept
     {
-        return std::hash<std::string>{}(key->inspect(false));
+        return key->hash();
     }
 };
 
 struct MalHashMapComparator {
-    constexpr bool operator()(MalType* lhs, MalType* rhs) const
+    bool operator()(MalType* lhs, MalType* rhs) const
     {
-        return lhs->inspect(false) == rhs->inspect(false);
+        return lhs == rhs || *lhs == *rhs;
     }
 };
 
+struct MalHashMapKeyTraits {
+    static std::size_t hash(MalType* key) { return HashMalHashMap {}(key); }
+    static bool equal(MalType* lhs, MalType* rhs) { return MalHashMapComparator {}(lhs, rhs); }
+};
+
+// A map whose keys are all keywords, up to RecordShape::max_keys of them, is stored as a shared
+// RecordShape plus a flat array of values in the shape's slot order; that is how records are usually
+// built. Any other map is a PersistentHashMap. Either way it behaves the same.
 class MalHashMap : public MalType {
 public:
+    using Map = PersistentHashMap<MalHashMapKeyTraits>;
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<MalType*, MalType*>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        Iterator(RecordShape const* shape, MalType* const* values, std::size_t index)
+            : m_shape(shape)
+            , m_values(values)
+            , m_index(index)
+        {
+        }
+
+        Iterator(Map::Iterator map_iterator)
+            : m_map_iterator(map_iterator)
+        {
+        }
+
+        value_type operator*() const { return m_shape ? value_type { m_shape->key(m_index), m_values[m_index] } : *m_map_iterator; }
+
+        Iterator& operator++()
+        {
+            if (m_shape)
+                ++m_index;
+            else
+                ++m_map_iterator;
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(Iterator const& other) const { return m_shape ? m_index == other.m_index : m_map_iterator == other.m_map_iterator; }
+
+    private:
+        RecordShape const* m_shape { nullptr };
+        MalType* const* m_values { nullptr };
+        std::size_t m_index { 0 };
+        Map::Iterator m_map_iterator;
+    };
+
+    MalHashMap() = default;
+
+    explicit MalHashMap(std::pmr::memory_resource* resource)
+        : m_hash_map(resource)
+    {
+    }
+
+    MalHashMap(Map hash_map)
+        : m_hash_map(hash_map)
+        , m_shape(nullptr)
+    {
+    }
+
+    // From alternating keys and values; a later value for the same key wins.
+    MalHashMap(std::span<MalType* const> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_hash_map(resource)
+    {
+        auto const* shape = RecordShape::empty();
+        for (std::size_t i = 0; i + 1 < elements.size() && shape; i += 2) {
+            if (!is_record_key(elements[i]))
+                shape = nullptr;
+            else if (shape->index_of(elements[i]) == shape->size())
+                shape = shape->size() < RecordShape::max_keys ? shape->with(elements[i]) : nullptr;
+        }
+        if (!shape) {
+            m_shape = nullptr;
+            for (std::size_t i = 0; i + 1 < elements.size(); i += 2)
+                insert_or_assign(elements[i], elements[i + 1]);
+            return;
+        }
+        m_shape = shape;
+        m_values = allocate_values(shape->size(), resource);
+        for (std::size_t i = 0; i + 1 < elements.size(); i += 2)
+            m_values[shape->index_of(elements[i])] = elements[i + 1];
+    }
+
+    // Only for a map that is still being built and not yet shared, which may then own its nodes
+    // (or, for a record, grow its value array in place).
     void insert_or_assign(MalType* key, MalType* value)
     {
-        m_hash_map.insert_or_assign(key, value);
+        if (m_shape) {
+            auto index = m_shape->index_of(key);
+            if (index < m_shape->size()) {
+                m_values[index] = value;
+                return;
+            }
+            if (is_record_key(key) && m_shape->size() < RecordShape::max_keys) {
+                // A record being built keeps a power of two capacity.
+                auto size = m_shape->size();
+                if (std::has_single_bit(size) || size == 0) {
+                    auto* values = allocate_values(std::max<std::size_t>(1, size * 2), resource());
+                    std::copy_n(m_values, size, values);
+                    m_values = values;
+                }
+                m_shape = m_shape->with(key);
+                m_values[size] = value;
+                return;
+            }
+            m_hash_map = to_hash_map();
+            m_shape = nullptr;
+        }
+        if (!m_hash_map.is_transient())
+            m_hash_map = m_hash_map.transient();
+        m_hash_map.assoc_in_place(key, value);
+    }
+
+    MalHashMap* assoc(MalType* key, MalType* value) const
+    {
+        if (!m_shape)
+            return new MalHashMap(m_hash_map.assoc(key, value));
+        auto index = m_shape->index_of(key);
+        if (index < m_shape->size()) {
+            auto* values = allocate_values(m_shape->size(), std::pmr::get_default_resource());
+            std::copy_n(m_values, m_shape->size(), values);
+            values[index] = value;
+            return new MalHashMap(m_shape, values, std::pmr::get_default_resource());
+        }
+        if (is_record_key(key) && m_shape->size() < RecordShape::max_keys) {
+            auto* values = allocate_values(m_shape->size() + 1, std::pmr::get_default_resource());
+            std::copy_n(m_values, m_shape->size(), values);
+            values[m_shape->size()] = value;
+            return new MalHashMap(m_shape->with(key), values, std::pmr::get_default_resource());
+        }
+        return new MalHashMap(to_hash_map().assoc(key, value));
+    }
+
+    MalHashMap* dissoc(MalType* key) const
+    {
+        if (!m_shape)
+            return new MalHashMap(m_hash_map.dissoc(key));
+        auto index = m_shape->index_of(key);
+        if (index == m_shape->size())
+            return new MalHashMap(m_shape, m_values, std::pmr::get_default_resource());
+        auto* values = allocate_values(m_shape->size() - 1, std::pmr::get_default_resource());
+        std::copy_n(m_values, index, values);
+        std::copy(m_values + index + 1, m_values + m_shape->size(), values + index);
+        return new MalHashMap(m_shape->without(index), values, std::pmr::get_default_resource());
     }
 
     MalType* find(MalType* key) const
     {
-        auto value = m_hash_map.find(key);
-        if (value != m_hash_map.end())
-            return value->second;
-        return {};
+        if (!m_shape)
+            return m_hash_map.find(key);
+        auto index = m_shape->index_of(key);
+        return index < m_shape->size() ? m_values[index] : nullptr;
     }
 
     std::string inspect(bool print_readably = false) const override
     {
         std::string result = "{";
-        for (auto [key, value] : m_hash_map)
+        for (auto [key, value] : *this)
             result.append(key->inspect(print_readably) + " " + value->inspect(print_readably) + " ");
 
+        if (size() > 0)
+            result[result.length() - 1] = '}';
+        else
+            result.append("}");
+        return result;
+    }
+
+    bool operator==(MalType const& other) const override;
+    std::size_t hash() const override;
+
+    Iterator begin() const { return m_shape ? Iterator { m_shape, m_values, 0 } : Iterator { m_hash_map.begin() }; }
+    Iterator end() const { return m_shape ? Iterator { m_shape, m_values, m_shape->size() } : Iterator { m_hash_map.end() }; }
+
+    bool empty() const { return size() == 0; }
+    std::size_t size() const { return m_shape ? m_shape->size() : m_hash_map.size(); }
+
+    // The shape of a record, or nullptr for a map stored by hashing.
+    RecordShape const* shape() const { return m_shape; }
+
+    // The same entries as a PersistentHashMap, for example to make a transient of them.
+    Map to_hash_map() const
+    {
+        if (!m_shape)
+            return m_hash_map;
+        auto hash_map = Map().transient();
+        for (std::size_t i = 0; i < m_shape->size(); ++i)
+            hash_map.assoc_in_place(m_shape->key(i), m_values[i]);
+        return hash_map.persistent();
+    }
+
+    Type type() const override { return Type::HashMap; }
+
+private:
+    MalHashMap(RecordShape const* shape, MalType** values, std::pmr::memory_resource* resource)
+        : m_hash_map(resource)
+        , m_shape(shape)
+        , m_values(values)
+    {
+    }
+
+    static bool is_record_key(MalType* key) { return key->type() == Type::Keyword; }
+
+    std::pmr::memory_resource* resource() const { return m_hash_map.resource(); }
+
+    // From resource() only while building this map: a map made from it allocates from the default resource.
+    static MalType** allocate_values(std::size_t count, std::pmr::memory_resource* resource)
+    {
+        if (count == 0)
+            return nullptr;
+        return static_cast<MalType**>(resource->allocate(count * sizeof(MalType*), alignof(MalType*)));
+    }
+
+    // Holds the entries only when m_shape is nullptr, but always holds the memory resource.
+    Map m_hash_map;
+    RecordShape const* m_shape { RecordShape::empty() };
+    MalType** m_values { nullptr };
+};
+
+// Maps are equal if they have equal keys mapped to equal values, whether they are sorted or not.
+// left is walked and right is searched, so right must be able to look up any key of left.
+template<typename LeftMap, typename RightMap>
+bool maps_equal(LeftMap const& left, RightMap const& right)
+{
+    if (left.size() != right.size())
+        return false;
+    for (auto [key, value] : left) {
+        auto* right_value = right.find(key);
+        if (!right_value || (value != right_value && *value != *right_value))
+            return false;
+    }
+    return true;
+}
+
+// Summed, so that the order of the entries does not matter.
+template<typename Map>
+std::size_t map_hash(Map const& map)
+{
+    std::size_t result = 0;
+    for (auto [key, value] : map)
+        result += key->hash() ^ (value->hash() * 31);
+    return result;
+}
+
+inline std::size_t MalHashMap::hash() const { return map_hash(*this); }
+
+// A vector that conj! and assoc! change in place, until persistent! turns it back into a MalVector.
+// Like in Clojure, it may not be used any more after that.
+class MalTransientVector : public MalType {
+public:
+    MalTransientVector(MalVector const& vector)
+        : m_vector(vector.persistent_vector().transient())
+    {
+    }
+
+    void conj(MalType* mal_type) { editable_vector().conj_in_place(mal_type); }
+    void assoc(std::size_t index, MalType* mal_type) { editable_vector().assoc_in_place(index, mal_type); }
+
+    MalVector* persistent()
+    {
+        auto* vector = new MalVector(editable_vector().persistent());
+        m_persisted = true;
+        return vector;
+    }
+
+    std::size_t size() const { return m_vector.size(); }
+
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override { return "#<transient vector>"; }
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::TransientVector; }
+
+private:
+    PersistentVector& editable_vector()
+    {
+        if (m_persisted)
+            throw new MalException("Transient used after persistent! call.");
+        return m_vector;
+    }
+
+    PersistentVector m_vector;
+    bool m_persisted { false };
+};
+
+class MalTransientHashMap : public MalType {
+public:
+    MalTransientHashMap(MalHashMap const& hash_map)
+        : m_hash_map(hash_map.to_hash_map().transient())
+    {
+    }
+
+    void assoc(MalType* key, MalType* value) { editable_hash_map().assoc_in_place(key, value); }
+    void dissoc(MalType* key) { editable_hash_map().dissoc_in_place(key); }
+
+    MalHashMap* persistent()
+    {
+        auto* hash_map = new MalHashMap(editable_hash_map().persistent());
+        m_persisted = true;
+        return hash_map;
+    }
+
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override { return "#<transient map>"; }
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::TransientHashMap; }
+
+private:
+    MalHashMap::Map& editable_hash_map()
+    {
+        if (m_persisted)
+            throw new MalException("Transient used after persistent! call.");
+        return m_hash_map;
+    }
+
+    MalHashMap::Map m_hash_map;
+    bool m_persisted { false };
+};
+
+// Each element is stored as a key mapped to itself, so that sets hash and compare their elements
+// exactly like maps do their keys.
+class MalHashSet : public MalType {
+public:
+    using Map = MalHashMap::Map;
+
+    MalHashSet() = default;
+
+    MalHashSet(Map hash_map)
+        : m_hash_map(hash_map)
+    {
+    }
+
+    MalHashSet(std::span<MalType* const> elements, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : m_hash_map(resource)
+    {
+        for (auto* element : elements)
+            insert(element);
+    }
+
+    // Only for a set that is still being built and not yet shared, which may then own its nodes.
+    void insert(MalType* element)
+    {
+        if (!m_hash_map.is_transient())
+            m_hash_map = m_hash_map.transient();
+        m_hash_map.assoc_in_place(element, element);
+    }
+
+    MalHashSet* conj(MalType* element) const { return new MalHashSet(m_hash_map.assoc(element, element)); }
+    MalHashSet* disj(MalType* element) const { return new MalHashSet(m_hash_map.dissoc(element)); }
+
+    MalType* find(MalType* element) const { return m_hash_map.find(element); }
+
+    std::string inspect(bool print_readably = false) const override
+    {
+        std::string result = "#{";
+        for (auto [element, ignored] : m_hash_map)
+            result.append(element->inspect(print_readably) + " ");
+
         if (m_hash_map.size() > 0)
             result[result.length() - 1] = '}';
         else
@@ -184,21 +752,179 @@ public:
         return result;
     }
 
-    bool operator==(MalType const&) const override
+    bool operator==(MalType const& other) const override;
+    std::size_t hash() const override;
+
+    auto begin() const { return m_hash_map.begin(); }
+    auto end() const { return m_hash_map.end(); }
+
+    Map const& hash_map() const { return m_hash_map; }
+
+    bool empty() const { return m_hash_map.empty(); }
+    std::size_t size() const { return m_hash_map.size(); }
+
+    Type type() const override { return Type::HashSet; }
+
+private:
+    Map m_hash_map;
+};
+
+// Summed, so that the order of the elements does not matter.
+template<typename Set>
+std::size_t set_hash(Set const& set)
+{
+    std::size_t result = 0;
+    for (auto [element, ignored] : set)
+        result += element->hash();
+    return result;
+}
+
+inline std::size_t MalHashSet::hash() const { return set_hash(*this); }
+
+// Orders nil first, then booleans, numbers, strings, keywords, symbols and sequences; a value of any
+// other type has no order and throws.
+struct MalSortedKeyTraits {
+    static int compare(MalType* lhs, MalType* rhs);
+};
+
+class MalSortedMap : public MalType {
+public:
+    using Map = PersistentSortedMap<MalSortedKeyTraits>;
+
+    MalSortedMap() = default;
+
+    MalSortedMap(Map sorted_map)
+        : m_sorted_map(sorted_map)
     {
-        // TODO
+    }
+
+    MalSortedMap* assoc(MalType* key, MalType* value) const { return new MalSortedMap(m_sorted_map.assoc(key, value)); }
+    MalSortedMap* dissoc(MalType* key) const { return new MalSortedMap(m_sorted_map.dissoc(key)); }
+
+    MalType* find(MalType* key) const { return m_sorted_map.find(key); }
+
+    std::string inspect(bool print_readably = false) const override
+    {
+        std::string result = "{";
+        for (auto [key, value] : m_sorted_map)
+            result.append(key->inspect(print_readably) + " " + value->inspect(print_readably) + " ");
+
+        if (m_sorted_map.size() > 0)
+            result[result.length() - 1] = '}';
+        else
+            result.append("}");
+        return result;
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (other.type() == Type::HashMap)
+            return maps_equal(*this, static_cast<MalHashMap const&>(other));
+        if (other.type() == Type::SortedMap)
+            return maps_equal(*this, static_cast<MalSortedMap const&>(other));
         return false;
     }
 
-    auto begin() { return m_hash_map.begin(); }
-    auto end() { return m_hash_map.end(); }
+    std::size_t hash() const override { return map_hash(*this); }
 
-    Type type() const override { return Type::HashMap; }
+    auto begin() const { return m_sorted_map.begin(); }
+    auto end() const { return m_sorted_map.end(); }
+
+    Map const& sorted_map() const { return m_sorted_map; }
+
+    bool empty() const { return m_sorted_map.empty(); }
+    std::size_t size() const { return m_sorted_map.size(); }
+
+    Type type() const override { return Type::SortedMap; }
 
 private:
-    std::unordered_map<MalType*, MalType*, HashMalHashMap, MalHashMapComparator> m_hash_map { };
+    Map m_sorted_map;
 };
 
+// Each element is stored as a key mapped to itself.
+class MalSortedSet : public MalType {
+public:
+    using Map = PersistentSortedMap<MalSortedKeyTraits>;
+
+    MalSortedSet() = default;
+
+    MalSortedSet(Map sorted_map)
+        : m_sorted_map(sorted_map)
+    {
+    }
+
+    MalSortedSet* conj(MalType* element) const { return new MalSortedSet(m_sorted_map.assoc(element, element)); }
+    MalSortedSet* disj(MalType* element) const { return new MalSortedSet(m_sorted_map.dissoc(element)); }
+
+    bool contains(MalType* element) const { return m_sorted_map.find(element); }
+
+    std::string inspect(bool print_readably = false) const override
+    {
+        std::string result = "#{";
+        for (auto [element, ignored] : m_sorted_map)
+            result.append(element->inspect(print_readably) + " ");
+
+        if (m_sorted_map.size() > 0)
+            result[result.length() - 1] = '}';
+        else
+            result.append("}");
+        return result;
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (other.type() == Type::HashSet)
+            return maps_equal(*this, static_cast<MalHashSet const&>(other));
+        if (other.type() == Type::SortedSet)
+            return maps_equal(*this, static_cast<MalSortedSet const&>(other));
+        return false;
+    }
+
+    std::size_t hash() const override { return set_hash(*this); }
+
+    auto begin() const { return m_sorted_map.begin(); }
+    auto end() const { return m_sorted_map.end(); }
+
+    MalType* find(MalType* element) const { return m_sorted_map.find(element); }
+
+    Map const& sorted_map() const { return m_sorted_map; }
+
+    bool empty() const { return m_sorted_map.empty(); }
+    std::size_t size() const { return m_sorted_map.size(); }
+
+    Type type() const override { return Type::SortedSet; }
+
+private:
+    Map m_sorted_map;
+};
+
+inline bool MalHashSet::operator==(MalType const& other) const
+{
+    if (other.type() == Type::SortedSet)
+        return maps_equal(static_cast<MalSortedSet const&>(other), *this);
+    if (other.type() != Type::HashSet)
+        return false;
+    return maps_equal(*this, static_cast<MalHashSet const&>(other));
+}
+
+inline bool MalHashMap::operator==(MalType const& other) const
+{
+    if (other.type() == Type::SortedMap)
+        return maps_equal(static_cast<MalSortedMap const&>(other), *this);
+    if (other.type() != Type::HashMap)
+        return false;
+    auto const& other_hash_map = static_cast<MalHashMap const&>(other);
+    if (m_shape && m_shape == other_hash_map.m_shape) {
+        // Records of the same shape: compare slot by slot.
+        for (std::size_t i = 0; i < m_shape->size(); ++i) {
+            if (m_values[i] != other_hash_map.m_values[i] && *m_values[i] != *other_hash_map.m_values[i])
+                return false;
+        }
+        return true;
+    }
+    return maps_equal(*this, other_hash_map);
+}
+
 class MalSymbol : public MalType {
 public:
     MalSymbol(std::string_view str)
@@ -213,56 +939,117 @@ public:
         return m_str == static_cast<MalSymbol const&>(other).m_str;
     }
 
+    std::size_t hash() const override { return std::hash<std::string>{}(m_str); }
+
     std::string inspect([[maybe_unused]]bool print_readably = false) const override { return m_str; }
 
     Type type() const override { return Type::Symbol; }
 
+    std::string const& value() const { return m_str; }
+
 private:
     std::string m_str;
 };
 
+// There is exactly one MalKeyword per name, made by intern(), so keywords are equal only if they are
+// the same object. Their hash is computed once, from the name, so that it spreads like a string hash.
 class MalKeyword : public MalType {
 public:
-    MalKeyword(std::string_view str)
-        : m_str(str)
+    static MalKeyword* intern(std::string_view str)
     {
+        {
+            std::shared_lock lock { s_keywords_mutex };
+            if (auto it = s_keywords.find(str); it != s_keywords.end())
+                return it->second;
+        }
+        std::unique_lock lock { s_keywords_mutex };
+        // Another thread may have added it in between.
+        if (auto it = s_keywords.find(str); it != s_keywords.end())
+            return it->second;
+        // Every isolate may use it, so it must not come from the region of the one that asked first.
+        ThreadLocalHeap::Scope global_heap { nullptr };
+        auto* keyword = new MalKeyword(str);
+        s_keywords.emplace(keyword->m_str, keyword);
+        return keyword;
     }
 
-    bool operator==(MalType const& other) const override
-    {
-        if (type() != other.type())
-            return false;
-        return m_str == static_cast<MalKeyword const&>(other).m_str;
-    }
+    bool operator==(MalType const& other) const override { return this == &other; }
+
+    std::size_t hash() const override { return m_hash; }
 
     std::string inspect([[maybe_unused]]bool print_readably = false) const override { return m_str; }
 
     Type type() const override { return Type::Keyword; }
 
+    std::string const& value() const { return m_str; }
+
 private:
+    MalKeyword(std::string_view str)
+        : m_str(str)
+        , m_hash(std::hash<std::string_view>{}(str))
+    {
+    }
+
+    // The keys view the names of the keywords themselves, which are never freed.
+    static inline std::unordered_map<std::string_view, MalKeyword*> s_keywords;
+    static inline std::shared_mutex s_keywords_mutex;
+
     std::string m_str;
+    std::size_t m_hash;
 };
 
+// Strings of up to inline_capacity characters are stored inside the object itself, which is as big as
+// a std::string with its shorter small-string buffer. Longer strings get one separate buffer, allocated
+// like the node, so that a region frees it with the node.
+// concat() of long strings makes a rope instead: a node that only points to its two halves, which is
+// flattened into a buffer of its own the first time its characters are needed. So appending to a long
+// string again and again costs O(1) per append rather than a copy of everything so far.
 class MalString : public MalType {
 public:
+    static constexpr std::size_t inline_capacity = 23;
+    // Results up to this long are copied flat; a rope of tiny pieces would cost more than it saves.
+    static constexpr std::size_t rope_threshold = 256;
+
     MalString(std::string_view str)
-        : m_str(str)
+        : m_length(str.length())
+        , m_kind(str.length() <= inline_capacity ? Inline : Heap)
     {
+        auto* chars = m_kind == Inline ? m_inline : (m_heap = static_cast<char*>(ThreadLocalHeap::allocate(m_length)));
+        std::copy(str.begin(), str.end(), chars);
+    }
+
+    MalString(MalString const&) = delete;
+    MalString& operator=(MalString const&) = delete;
+
+    static MalString* concat(MalString* left, MalString* right)
+    {
+        if (left->m_length == 0)
+            return right;
+        if (right->m_length == 0)
+            return left;
+        if (left->m_length + right->m_length <= rope_threshold)
+            return new MalString(std::string(left->value()).append(right->value()));
+        return new MalString(left, right);
     }
 
     bool operator==(MalType const& other) const override
     {
+        if (this == &other)
+            return true;
         if (type() != other.type())
             return false;
-        return m_str == static_cast<MalString const&>(other).m_str;
+        auto const& other_string = static_cast<MalString const&>(other);
+        return m_length == other_string.m_length && value() == other_string.value();
     }
 
+    std::size_t hash() const override { return std::hash<std::string_view>{}(value()); }
+
     std::string inspect(bool print_readably = false) const override {
         if (!print_readably)
-            return m_str;
+            return std::string(value());
 
         std::string result;
-        for (auto c : m_str) {
+        for (auto c : value()) {
             switch (c) {
                 case '"':
                     result += "\\\"";
@@ -284,8 +1071,249 @@ public:
 
     Type type() const override { return Type::String; }
 
+    std::size_t length() const { return m_length; }
+
+    std::string_view value() const
+    {
+        if (m_kind == Rope)
+            return { flat(), m_length };
+        return { m_kind == Inline ? m_inline : m_heap, m_length };
+    }
+
 private:
-    std::string m_str;
+    enum Kind {
+        Inline,
+        Heap,
+        Rope,
+    };
+
+    MalString(MalString const* left, MalString const* right)
+        : m_rope { left, right, nullptr }
+        , m_length(left->m_length + right->m_length)
+        , m_kind(Rope)
+    {
+    }
+
+    // The rope's characters, copied into a buffer the first time. The buffer is allocated like a node,
+    // from the region of the thread that flattens the rope, if it has one. Threads that race to do so
+    // each make a copy, and all but the first to publish theirs simply drop it, as nodes are dropped.
+    char const* flat() const
+    {
+        if (auto const* chars = m_rope.flat.load(std::memory_order_acquire))
+            return chars;
+        auto* chars = flatten();
+        char const* expected = nullptr;
+        if (m_rope.flat.compare_exchange_strong(expected, chars, std::memory_order_acq_rel))
+            return chars;
+        return expected;
+    }
+
+    // Copies the leaves left to right, with an explicit stack: ropes built by appending are as deep as
+    // the number of appends. Pieces that are already flat are copied whole.
+    char* flatten() const
+    {
+        auto* chars = static_cast<char*>(ThreadLocalHeap::allocate(m_length));
+        auto* out = chars;
+        std::vector<MalString const*> pending { m_rope.right, m_rope.left };
+        while (!pending.empty()) {
+            auto const* piece = pending.back();
+            pending.pop_back();
+            if (piece->m_kind != Rope) {
+                out = std::copy_n(piece->m_kind == Inline ? piece->m_inline : piece->m_heap, piece->m_length, out);
+            } else if (auto const* piece_chars = piece->m_rope.flat.load(std::memory_order_acquire)) {
+                out = std::copy_n(piece_chars, piece->m_length, out);
+            } else {
+                pending.push_back(piece->m_rope.right);
+                pending.push_back(piece->m_rope.left);
+            }
+        }
+        return chars;
+    }
+
+    struct Halves {
+        MalString const* left;
+        MalString const* right;
+        mutable std::atomic<char const*> flat;
+    };
+
+    union {
+        char m_inline[inline_capacity];
+        char* m_heap;
+        Halves m_rope;
+    };
+    std::size_t m_length : 62;
+    std::size_t m_kind : 2;
+};
+
+// Collects text for sb-append! in an amortized buffer, until sb->str turns it into a MalString.
+class MalStringBuilder : public MalType {
+public:
+    void append(std::string_view str) { m_buffer.append(str); }
+
+    MalString* to_string() const { return new MalString(m_buffer); }
+
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override { return "#<string builder>"; }
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::StringBuilder; }
+
+private:
+    std::string m_buffer;
+};
+
+class WorkStealingPool;
+
+// The result of a (future expr), computed on a WorkStealingPool: core.cpp's future_call() submits it and
+// deref waits for it. An exception thrown by expr is kept and rethrown by every deref.
+class MalFuture : public MalType {
+public:
+    explicit MalFuture(WorkStealingPool& pool)
+        : m_pool(pool)
+    {
+    }
+
+    void deliver(MalType* value) { realize(value, nullptr); }
+    void fail(MalException* exception) { realize(nullptr, exception); }
+
+    bool is_realized() const { return m_realized.load(std::memory_order_acquire); }
+
+    // Returns once the future is realized, or after timeout.
+    void wait_for(std::chrono::milliseconds timeout) const
+    {
+        std::unique_lock lock { m_mutex };
+        m_realized_condition.wait_for(lock, timeout, [this] { return is_realized(); });
+    }
+
+    // The future must be realized.
+    MalType* value() const
+    {
+        assert(is_realized());
+        if (m_exception)
+            throw m_exception;
+        return m_value;
+    }
+
+    WorkStealingPool& pool() const { return m_pool; }
+
+    std::string inspect(bool print_readably = false) const override
+    {
+        if (!is_realized())
+            return "#<future pending>";
+        if (m_exception)
+            return "#<future failed>";
+        return "#<future " + m_value->inspect(print_readably) + ">";
+    }
+
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::Future; }
+
+private:
+    void realize(MalType* value, MalException* exception)
+    {
+        {
+            std::lock_guard lock { m_mutex };
+            m_value = value;
+            m_exception = exception;
+            m_realized.store(true, std::memory_order_release);
+        }
+        m_realized_condition.notify_all();
+    }
+
+    WorkStealingPool& m_pool;
+    std::atomic<bool> m_realized { false };
+    MalType* m_value { nullptr };
+    MalException* m_exception { nullptr };
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_realized_condition;
+};
+
+// A mutable reference to an immutable value, shared between threads without a lock. core.cpp's swap!
+// applies its function to the current value and installs the result with a compare-and-swap, and applies
+// it again to the newer value if another thread got there first, so the function should have no side
+// effects. The counters tell how often that happens: retries against swaps is the contention on the atom.
+class MalAtom : public MalType {
+public:
+    struct Statistics {
+        std::size_t swaps;
+        std::size_t retries;
+    };
+
+    explicit MalAtom(MalType* value)
+        : m_value(value)
+    {
+    }
+
+    MalType* value() const { return m_value.load(std::memory_order_acquire); }
+
+    // Returns the value replaced.
+    MalType* reset(MalType* value) { return m_value.exchange(value, std::memory_order_acq_rel); }
+
+    // Replaces expected with desired if the atom still holds expected, or stores what it holds in
+    // expected otherwise.
+    bool compare_and_set(MalType*& expected, MalType* desired)
+    {
+        return m_value.compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+    }
+
+    // Replaces the value with function(value), and returns the value replaced and the new one.
+    template<typename Function>
+    std::pair<MalType*, MalType*> swap(Function function)
+    {
+        auto* old_value = value();
+        auto* new_value = function(old_value);
+        while (!compare_and_set(old_value, new_value)) {
+            m_retries.fetch_add(1, std::memory_order_relaxed);
+            new_value = function(old_value);
+        }
+        m_swaps.fetch_add(1, std::memory_order_relaxed);
+        return { old_value, new_value };
+    }
+
+    Statistics statistics() const
+    {
+        return { m_swaps.load(std::memory_order_relaxed), m_retries.load(std::memory_order_relaxed) };
+    }
+
+    std::string inspect(bool print_readably = false) const override { return "(atom " + value()->inspect(print_readably) + ")"; }
+
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::Atom; }
+
+private:
+    std::atomic<MalType*> m_value;
+    std::atomic<std::size_t> m_swaps { 0 };
+    std::atomic<std::size_t> m_retries { 0 };
+};
+
+// A chan: a bounded queue of values between threads (see Channel). Unlike other values, channels are made
+// on the global heap, so that isolates can use one to talk to each other whichever is destroyed first.
+class MalChannel : public MalType {
+public:
+    explicit MalChannel(std::size_t capacity)
+        : m_channel(new ::Channel(capacity))
+    {
+    }
+
+    ::Channel& channel() const { return *m_channel; }
+
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override
+    {
+        return m_channel->is_closed() ? "#<channel closed>" : "#<channel>";
+    }
+
+    bool operator==(MalType const& other) const override { return this == &other; }
+    std::size_t hash() const override { return std::hash<MalType const*>{}(this); }
+
+    Type type() const override { return Type::Channel; }
+
+private:
+    // Separately, as it is aligned to cache lines and MalType nodes are not.
+    ::Channel* m_channel;
 };
 
 class MalNil : public MalType {
@@ -338,6 +1366,8 @@ public:
         return m_long == static_cast<MalInteger const&>(other).m_long;
     }
 
+    std::size_t hash() const override { return std::hash<long int>{}(m_long); }
+
     std::string inspect([[maybe_unused]]bool print_readably = false) const override { return std::to_string(value()); }
 
     Type type() const override { return Type::Integer; }
@@ -348,6 +1378,176 @@ private:
     long int m_long { 0 };
 };
 
+// An integer outside the range of long. Arithmetic returns one only when its result does not fit in a
+// MalInteger, so every integer has a single representation and the two types never compare equal.
+class MalBigInteger : public MalType {
+public:
+    MalBigInteger(BigInteger value)
+        : m_value(std::move(value))
+    {
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (type() != other.type())
+            return false;
+        return m_value == static_cast<MalBigInteger const&>(other).m_value;
+    }
+
+    std::size_t hash() const override { return m_value.hash(); }
+
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override { return m_value.to_string(); }
+
+    Type type() const override { return Type::BigInteger; }
+
+    BigInteger const& value() const { return m_value; }
+
+private:
+    BigInteger m_value;
+};
+
+class MalFloat : public MalType {
+public:
+    MalFloat(double double_value)
+        : m_double(double_value)
+    {
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (type() != other.type())
+            return false;
+        return m_double == static_cast<MalFloat const&>(other).m_double;
+    }
+
+    std::size_t hash() const override { return std::hash<double>{}(m_double); }
+
+    // The shortest digits that read back as the same double, always with a '.' or an exponent so that
+    // they read back as a float at all. Infinities and NaN print as Clojure's ##Inf, ##-Inf and ##NaN.
+    std::string inspect([[maybe_unused]]bool print_readably = false) const override
+    {
+        if (std::isnan(m_double))
+            return "##NaN";
+        if (std::isinf(m_double))
+            return m_double > 0 ? "##Inf" : "##-Inf";
+        char buffer[32];
+        auto [end, error_code] = std::to_chars(buffer, buffer + sizeof(buffer), m_double);
+        std::string result { buffer, end };
+        if (result.find_first_of(".e") == std::string::npos)
+            result += ".0";
+        return result;
+    }
+
+    Type type() const override { return Type::Float; }
+
+    double value() const { return m_double; }
+
+private:
+    double m_double { 0 };
+};
+
+// A fixed-size array of unboxed numbers, all longs or all doubles, for the bulk builtins (asum, amap+...)
+// in core.cpp. Like the other collections it is never changed once made.
+class MalNumArray : public MalType {
+public:
+    enum class ElementType {
+        Integer,
+        Float
+    };
+
+    MalNumArray(std::vector<long> integers)
+        : m_element_type(ElementType::Integer)
+        , m_integers(std::move(integers))
+    {
+    }
+
+    MalNumArray(std::vector<double> floats)
+        : m_element_type(ElementType::Float)
+        , m_floats(std::move(floats))
+    {
+    }
+
+    bool operator==(MalType const& other) const override
+    {
+        if (type() != other.type())
+            return false;
+        auto const& other_array = static_cast<MalNumArray const&>(other);
+        return m_element_type == other_array.m_element_type && m_integers == other_array.m_integers && m_floats == other_array.m_floats;
+    }
+
+    std::size_t hash() const override
+    {
+        std::size_t result = static_cast<std::size_t>(m_element_type);
+        for (auto value : m_integers)
+            result = result * 31 + std::hash<long> {}(value);
+        for (auto value : m_floats)
+            result = result * 31 + std::hash<double> {}(value);
+        return result;
+    }
+
+    std::string inspect(bool print_readably = false) const override
+    {
+        std::string result = "#num-array[";
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (i > 0)
+                result += ' ';
+            result += at(i)->inspect(print_readably);
+        }
+        return result + ']';
+    }
+
+    Type type() const override { return Type::NumArray; }
+
+    ElementType element_type() const { return m_element_type; }
+    std::size_t size() const { return m_element_type == ElementType::Integer ? m_integers.size() : m_floats.size(); }
+    std::span<long const> integers() const { return m_integers; }
+    std::span<double const> floats() const { return m_floats; }
+
+    // The element at index, boxed.
+    MalType* at(std::size_t index) const
+    {
+        if (m_element_type == ElementType::Integer)
+            return new MalInteger(m_integers[index]);
+        return new MalFloat(m_floats[index]);
+    }
+
+private:
+    ElementType m_element_type;
+    std::vector<long> m_integers;
+    std::vector<double> m_floats;
+};
+
+inline bool is_integer(MalType const* mal_type)
+{
+    return mal_type->type() == MalType::Type::Integer || mal_type->type() == MalType::Type::BigInteger;
+}
+
+// The value of a MalInteger or MalBigInteger.
+inline BigInteger integer_value(MalType const* mal_type)
+{
+    if (mal_type->type() == MalType::Type::Integer)
+        return BigInteger { static_cast<MalInteger const*>(mal_type)->value() };
+    return static_cast<MalBigInteger const*>(mal_type)->value();
+}
+
+// The value of a MalInteger, MalBigInteger or MalFloat as a double.
+inline double float_value(MalType const* mal_type)
+{
+    switch (mal_type->type()) {
+    case MalType::Type::Integer: return static_cast<double>(static_cast<MalInteger const*>(mal_type)->value());
+    case MalType::Type::BigInteger: return static_cast<MalBigInteger const*>(mal_type)->value().to_double();
+    default: return static_cast<MalFloat const*>(mal_type)->value();
+    }
+}
+
+// A MalInteger if value fits in one, a MalBigInteger otherwise.
+inline MalType* make_integer(BigInteger value)
+{
+    if (value.fits_long())
+        return new MalInteger(value.to_long());
+    return new MalBigInteger(std::move(value));
+}
+
 using MalFunctionPtr = std::function<MalType*(size_t, MalType**)>;
 
 class MalFunction : public MalType {
@@ -369,20 +1569,77 @@ public:
     std::string inspect([[maybe_unused]]bool print_readably = false) const override { return "#<function>"; }
 
     MalFunctionPtr function_ptr() const { return  m_function_ptr; }
+    // Without copying it, for a caller that calls it in a loop.
+    MalFunctionPtr const& function() const { return m_function_ptr; }
 
 private:
     MalFunctionPtr m_function_ptr;
 };
 
-class MalException : public std::exception {
-public:
-    MalException(std::string_view message)
-        : m_message(message)
-    {
+inline int MalSortedKeyTraits::compare(MalType* lhs, MalType* rhs)
+{
+    auto rank = [](MalType* mal_type) {
+        switch (mal_type->type()) {
+        case MalType::Type::Nil: return 0;
+        case MalType::Type::False:
+        case MalType::Type::True: return 1;
+        case MalType::Type::Integer:
+        case MalType::Type::BigInteger:
+        case MalType::Type::Float: return 2;
+        case MalType::Type::String: return 3;
+        case MalType::Type::Keyword: return 4;
+        case MalType::Type::Symbol: return 5;
+        case MalType::Type::List:
+        case MalType::Type::Vector: return 6;
+        default: throw new MalException("Cannot compare a " + mal_type->type_as_string() + ".");
+        }
+    };
+    auto lhs_rank = rank(lhs);
+    auto rhs_rank = rank(rhs);
+    if (lhs_rank != rhs_rank)
+        return lhs_rank - rhs_rank;
+
+    switch (lhs->type()) {
+    case MalType::Type::Nil:
+        return 0;
+    case MalType::Type::False:
+    case MalType::Type::True:
+        return (lhs->type() == MalType::Type::True) - (rhs->type() == MalType::Type::True);
+    case MalType::Type::Integer:
+    case MalType::Type::BigInteger:
+    case MalType::Type::Float: {
+        if (lhs->type() == MalType::Type::Float || rhs->type() == MalType::Type::Float) {
+            auto lhs_value = float_value(lhs);
+            auto rhs_value = float_value(rhs);
+            // NaN compares false with everything, so it is put after every other number instead, and
+            // any NaN is the same key as another.
+            if (std::isnan(lhs_value) || std::isnan(rhs_value))
+                return std::isnan(lhs_value) - std::isnan(rhs_value);
+            return (lhs_value > rhs_value) - (lhs_value < rhs_value);
+        }
+        if (lhs->type() != MalType::Type::Integer || rhs->type() != MalType::Type::Integer)
+            return integer_value(lhs).compare(integer_value(rhs));
+        auto lhs_value = static_cast<MalInteger*>(lhs)->value();
+        auto rhs_value = static_cast<MalInteger*>(rhs)->value();
+        return (lhs_value > rhs_value) - (lhs_value < rhs_value);
     }
-
-    char const* what() const noexcept  override { return m_message.c_str(); }
-
-private:
-    std::string m_message;
-};
\ No newline at end of file
+    case MalType::Type::String:
+        return static_cast<MalString*>(lhs)->value().compare(static_cast<MalString*>(rhs)->value());
+    case MalType::Type::Keyword:
+        return static_cast<MalKeyword*>(lhs)->value().compare(static_cast<MalKeyword*>(rhs)->value());
+    case MalType::Type::Symbol:
+        return static_cast<MalSymbol*>(lhs)->value().compare(static_cast<MalSymbol*>(rhs)->value());
+    default: {
+        // Shorter sequences first, then element by element.
+        auto lhs_size = sequence_size(lhs);
+        auto rhs_size = sequence_size(rhs);
+        if (lhs_size != rhs_size)
+            return lhs_size < rhs_size ? -1 : 1;
+        for (std::size_t i = 0; i < lhs_size; ++i) {
+            if (auto order = compare(sequence_at(lhs, i), sequence_at(rhs, i)))
+                return order;
+        }
+        return 0;
+    }
+    }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own deque of tasks. A worker pushes the tasks it spawns
+// onto the back of its own deque and pops from the back too, newest first, while their data is still in
+// its cache; when its deque is empty it steals the oldest task from the front of another worker's deque,
+// which in a divide-and-conquer computation is the biggest piece of work left. Tasks submitted from
+// outside the pool are dealt out round-robin.
+//
+// A thread that has to wait for a task's result should call run_one() meanwhile (see deref in core.cpp),
+// so that the tasks the result depends on cannot be stuck behind a waiting worker. A wait that only
+// another thread can end, such as a channel operation, goes through blocking() instead: on a worker, a
+// spare thread takes over the worker's deque for as long as the wait lasts, like a compensating thread
+// of Java's ForkJoinPool, so that the task that would end the wait still gets to run.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(std::size_t worker_count)
+    {
+        worker_count = std::max<std::size_t>(worker_count, 1);
+        for (std::size_t i = 0; i < worker_count; ++i)
+            m_workers.push_back(std::make_unique<Worker>());
+        for (std::size_t i = 0; i < worker_count; ++i)
+            m_threads.emplace_back([this, i] { work(i); });
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard lock { m_idle_mutex };
+            m_stopping = true;
+        }
+        m_idle.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+        std::unique_lock lock { m_idle_mutex };
+        m_idle.wait(lock, [this] { return m_spares == 0; });
+    }
+
+    // The pool future runs on, with a worker per hardware thread, or one when hardware_concurrency() does
+    // not know. It is never destroyed, so that exiting does not wait for the tasks still running on it.
+    static WorkStealingPool& instance()
+    {
+        static auto* s_instance = new WorkStealingPool(std::max(1u, std::thread::hardware_concurrency()));
+        return *s_instance;
+    }
+
+    std::size_t worker_count() const { return m_workers.size(); }
+
+    void submit(Task task)
+    {
+        auto index = s_pool == this ? s_worker_index : m_next_worker++ % m_workers.size();
+        {
+            std::lock_guard lock { m_workers[index]->mutex };
+            m_workers[index]->tasks.push_back(std::move(task));
+        }
+        // Either the sleeper sees the new count, or this sees the sleeper; both sides use seq_cst.
+        m_queued.fetch_add(1);
+        if (m_sleeping.load() > 0) {
+            { std::lock_guard lock { m_idle_mutex }; }
+            m_idle.notify_one();
+        }
+    }
+
+    // Returns wait(), which blocks until another thread acts. Off the pool's workers this is just wait();
+    // on a worker, a spare thread runs the worker's tasks meanwhile and stops after the one it is running
+    // when wait() returns. Starting the spare costs a thread, so try what may not block first.
+    template<typename Wait>
+    static auto blocking(Wait wait) -> decltype(wait())
+    {
+        auto* pool = s_pool;
+        if (!pool)
+            return wait();
+        auto released = std::make_shared<std::atomic<bool>>(false);
+        {
+            std::lock_guard lock { pool->m_idle_mutex };
+            ++pool->m_spares;
+        }
+        std::thread([pool, index = s_worker_index, released] { pool->work(index, released.get()); }).detach();
+        struct Release {
+            WorkStealingPool* pool;
+            std::atomic<bool>& released;
+            ~Release()
+            {
+                {
+                    std::lock_guard lock { pool->m_idle_mutex };
+                    released = true;
+                }
+                pool->m_idle.notify_all();
+            }
+        } release { pool, *released };
+        return wait();
+    }
+
+    // Runs one queued task, if there is any. A worker tries its own deque first.
+    bool run_one()
+    {
+        Task task;
+        if (!take(s_pool == this ? s_worker_index : m_next_victim++ % m_workers.size(), task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool take(std::size_t index, Task& task)
+    {
+        if (m_queued.load(std::memory_order_relaxed) <= 0)
+            return false;
+        if (pop(*m_workers[index], task, s_pool == this))
+            return true;
+        for (std::size_t i = 1; i < m_workers.size(); ++i) {
+            if (pop(*m_workers[(index + i) % m_workers.size()], task, false))
+                return true;
+        }
+        return false;
+    }
+
+    bool pop(Worker& worker, Task& task, bool own)
+    {
+        std::lock_guard lock { worker.mutex };
+        if (worker.tasks.empty())
+            return false;
+        if (own) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // A spare (see blocking()) stands in for worker index until released, and then exits.
+    void work(std::size_t index, std::atomic<bool> const* released = nullptr)
+    {
+        s_pool = this;
+        s_worker_index = index;
+        auto is_released = [released] { return released && released->load(); };
+        while (!is_released()) {
+            Task task;
+            if (take(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock lock { m_idle_mutex };
+            ++m_sleeping;
+            m_idle.wait(lock, [&] { return m_queued.load() > 0 || m_stopping || is_released(); });
+            --m_sleeping;
+            if (m_stopping)
+                break;
+        }
+        if (released) {
+            {
+                std::lock_guard lock { m_idle_mutex };
+                --m_spares;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    // The pool and worker the current thread belongs to, if any.
+    static inline thread_local WorkStealingPool* s_pool { nullptr };
+    static inline thread_local std::size_t s_worker_index { 0 };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    // Signed, as a task may be taken before the count of its submission is added.
+    std::atomic<long> m_queued { 0 };
+    std::atomic<std::size_t> m_next_worker { 0 };
+    std::atomic<std::size_t> m_next_victim { 0 };
+
+    std::mutex m_idle_mutex;
+    std::condition_variable m_idle;
+    std::atomic<std::size_t> m_sleeping { 0 };
+    // Spare threads that have not exited yet, which the destructor waits for.
+    std::size_t m_spares { 0 };
+    bool m_stopping { false };
+};